@@ -2,21 +2,10 @@
 #include "DataTypes.h"
 #include "Fault.h"
 #include <string.h>
-
-// Define USE_LOCK to use the default lock implementation
-#define USE_LOCKS
-#ifdef USE_LOCKS
-    #include "LockGuard.h"
-    static LOCK_HANDLE _hLock;
+#if WIN32
+    #include "windows.h"
 #else
-    #pragma message("WARNING: Define software lock.")
-    typedef int LOCK_HANDLE;
-    static LOCK_HANDLE _hLock;
-
-    #define LK_CREATE()     (1)
-    #define LK_DESTROY(h)  
-    #define LK_LOCK(h)    
-    #define LK_UNLOCK(h)  
+    #include <pthread.h>
 #endif
 
 // Get a pointer to the client's area within a memory block
@@ -27,27 +16,194 @@
 #define GET_BLOCK_PTR(_client_ptr_) \
     (_client_ptr_ ? ((void*)((char*)_client_ptr_)) : NULL)
 
+// Pack and unpack the tagged free-list head
+#define HEAD_INDEX(_head_)          ((UINT32)((UINT64)(_head_) & 0xFFFFFFFF))
+#define HEAD_TAG(_head_)            ((UINT32)((UINT64)(_head_) >> 32))
+#define MAKE_HEAD(_tag_, _index_)   ((INT64)(((UINT64)(_tag_) << 32) | (UINT32)(_index_)))
+
+#if WIN32
+    #define ALLOC_THREAD_LOCAL      __declspec(thread)
+#else
+    #define ALLOC_THREAD_LOCAL      __thread
+#endif
+
+// A per-thread cache of free blocks for one allocator
+typedef struct
+{
+    void* blocks[ALLOC_MAGAZINE_SIZE];
+    UINT32 count;
+    ALLOC_MagazineStats stats;
+} ALLOC_Magazine;
+
+// Each thread has one magazine slot per magazine enabled allocator
+static ALLOC_THREAD_LOCAL ALLOC_Magazine _magazines[ALLOC_MAX_MAGAZINES];
+static ALLOC_Allocator* volatile _magazineOwners[ALLOC_MAX_MAGAZINES];
+static ATOMIC_INT32 _magazineCount;
+
+// Thread exit hook that flushes the exiting thread's magazines. Each thread
+// registers once, on first storing a block within a magazine.
+#if WIN32
+static DWORD _magazineKey = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t _magazineKey;
+#endif
+static ATOMIC_INT32 _magazineKeyCreated;
+static ALLOC_THREAD_LOCAL BOOL _magazineRegistered;
+
+static char* ALLOC_GetSlab(ALLOC_Allocator* alloc, UINT32 slab);
+static void* ALLOC_TryNewBlock(ALLOC_Allocator* alloc);
 static void* ALLOC_NewBlock(ALLOC_Allocator* alloc);
 static void ALLOC_Push(ALLOC_Allocator* alloc, void* pBlock);
+static void ALLOC_PushChain(ALLOC_Allocator* alloc, ALLOC_Block* pFirst, ALLOC_Block* pLast);
 static void* ALLOC_Pop(ALLOC_Allocator* alloc);
+static UINT32 ALLOC_PopChain(ALLOC_Allocator* alloc, void** blocks, UINT32 count);
+static ALLOC_Block* ALLOC_FindBlock(ALLOC_Allocator* alloc, UINT32 index);
+static void ALLOC_TrackAlloc(ALLOC_Allocator* alloc, void* pBlock);
+static ALLOC_Block* ALLOC_GetBlock(ALLOC_Allocator* alloc, UINT32 index);
+static UINT32 ALLOC_GetIndex(ALLOC_Allocator* alloc, void* pBlock);
+static void* ALLOC_MagazineAlloc(ALLOC_Allocator* alloc, ALLOC_Magazine* mag);
+static void ALLOC_MagazineFree(ALLOC_Allocator* alloc, ALLOC_Magazine* mag, void* pBlock);
+static void ALLOC_MagazineFlush(ALLOC_Allocator* alloc, ALLOC_Magazine* mag, UINT32 num);
+static void ALLOC_CreateMagazineKey(void);
+static void ALLOC_RegisterMagazines(void);
 
 //----------------------------------------------------------------------------
-// ALLOC_NewBlock
+// ALLOC_GetBlock
 //----------------------------------------------------------------------------
-static void* ALLOC_NewBlock(ALLOC_Allocator* self)
+static ALLOC_Block* ALLOC_GetBlock(ALLOC_Allocator* self, UINT32 index)
+{
+    char* pSlab;
+
+    if (index < self->maxBlocks)
+        return (ALLOC_Block*)(self->pPool + (index * self->blockSize));
+
+    // The block is within a heap slab
+    index -= self->maxBlocks;
+    pSlab = (char*)AT_LOAD_PTR(&self->pSlabs[index / self->slabBlocks]);
+    ASSERT_TRUE(pSlab);
+    return (ALLOC_Block*)(pSlab + ((index % self->slabBlocks) * self->blockSize));
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_FindBlock
+//----------------------------------------------------------------------------
+static ALLOC_Block* ALLOC_FindBlock(ALLOC_Allocator* self, UINT32 index)
+{
+    char* pSlab;
+
+    // A block index read from a stale free-list link may be anything. Only 
+    // return blocks that were handed out at least once.
+    if (index >= (UINT32)AT_LOAD32(&self->poolIndex))
+        return NULL;
+    if (index < self->maxBlocks)
+        return ALLOC_GetBlock(self, index);
+
+    pSlab = (char*)AT_LOAD_PTR(&self->pSlabs[(index - self->maxBlocks) / self->slabBlocks]);
+    if (!pSlab)
+        return NULL;
+    return (ALLOC_Block*)(pSlab + (((index - self->maxBlocks) % self->slabBlocks) * self->blockSize));
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_GetIndex
+//----------------------------------------------------------------------------
+static UINT32 ALLOC_GetIndex(ALLOC_Allocator* self, void* pBlock)
+{
+    const char* p = (const char*)pBlock;
+    size_t slabSize = self->slabBlocks * self->blockSize;
+    UINT32 slab;
+
+    if (p >= self->pPool && p < self->pPool + (self->maxBlocks * self->blockSize))
+        return (UINT32)((p - self->pPool) / self->blockSize);
+
+    // Search the heap slabs for the block
+    for (slab = 0; slab < self->maxSlabs; slab++)
+    {
+        const char* pSlab = (const char*)AT_LOAD_PTR(&self->pSlabs[slab]);
+        if (pSlab && p >= pSlab && p < pSlab + slabSize)
+        {
+            return self->maxBlocks + (slab * self->slabBlocks) + 
+                (UINT32)((p - pSlab) / self->blockSize);
+        }
+    }
+
+    // Block not owned by this allocator
+    ASSERT();
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_GetSlab
+//----------------------------------------------------------------------------
+static char* ALLOC_GetSlab(ALLOC_Allocator* self, UINT32 slab)
+{
+    char* pSlab = (char*)AT_LOAD_PTR(&self->pSlabs[slab]);
+    if (pSlab)
+        return pSlab;
+
+    // malloc() memory is suitably aligned for any type, so each block within 
+    // the slab keeps the ALLOC_MEM_ALIGN alignment of blockSize
+    pSlab = (char*)malloc(self->slabBlocks * self->blockSize);
+    if (!pSlab)
+        return NULL;
+
+    // Another thread claiming a block within the same slab may install first.
+    // If so, use its slab and discard ours.
+    if (AT_CAS_PTR(&self->pSlabs[slab], NULL, pSlab))
+    {
+        AT_ADD32(&self->slabCount, 1);
+        return pSlab;
+    }
+
+    free(pSlab);
+    return (char*)AT_LOAD_PTR(&self->pSlabs[slab]);
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_TryNewBlock
+//----------------------------------------------------------------------------
+static void* ALLOC_TryNewBlock(ALLOC_Allocator* self)
 {
     ALLOC_Block* pBlock = NULL;
+    UINT32 maxIndex = self->maxBlocks + (self->slabBlocks * self->maxSlabs);
+    INT32 index = AT_LOAD32(&self->poolIndex);
+
+    ASSERT_TRUE(self->maxSlabs <= ALLOC_MAX_SLABS);
 
-    LK_LOCK(_hLock);
+    // Free blocks are linked with atomic operations on ALLOC_Block::next
+    ASSERT_TRUE(self->blockSize % ALLOC_MEM_ALIGN == 0);
+    ASSERT_TRUE(((size_t)self->pPool % ALLOC_MEM_ALIGN) == 0);
 
-    // If we have not exceeded the pool maximum
-    if (self->poolIndex < self->maxBlocks)
+    // If we have not exceeded the pool and slab maximum
+    while ((UINT32)index < maxIndex)
     {
-        // Get pointer to a new fixed memory block within the pool
-        pBlock = (void*)(self->pPool + (self->poolIndex++ * self->blockSize));
+        // Allocate the heap slab on first use of any of its blocks. Install it
+        // before claiming the index so a failed malloc() loses nothing.
+        if ((UINT32)index >= self->maxBlocks && 
+            !ALLOC_GetSlab(self, ((UINT32)index - self->maxBlocks) / self->slabBlocks))
+        {
+            // Heap exhausted
+            break;
+        }
+
+        // Claim the next never used block within the pool or slabs
+        if (AT_CAS32(&self->poolIndex, index, index + 1))
+        {
+            pBlock = ALLOC_GetBlock(self, (UINT32)index);
+            break;
+        }
+        index = AT_LOAD32(&self->poolIndex);
     }
 
-    LK_UNLOCK(_hLock);
+    return pBlock;
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_NewBlock
+//----------------------------------------------------------------------------
+static void* ALLOC_NewBlock(ALLOC_Allocator* self)
+{
+    void* pBlock = ALLOC_TryNewBlock(self);
 
     if (!pBlock)
     {
@@ -69,15 +225,28 @@ static void ALLOC_Push(ALLOC_Allocator* self, void* pBlock)
     // Get a pointer to the client's location within the block
     ALLOC_Block* pClient = (ALLOC_Block*)GET_CLIENT_PTR(pBlock);
 
-    LK_LOCK(_hLock);
+    ALLOC_PushChain(self, pClient, pClient);
+}
 
-    // Point client block's next pointer to head
-    pClient->pNext = self->pHead;
+//----------------------------------------------------------------------------
+// ALLOC_PushChain
+//----------------------------------------------------------------------------
+static void ALLOC_PushChain(ALLOC_Allocator* self, ALLOC_Block* pFirst, ALLOC_Block* pLast)
+{
+    INT64 head;
+    UINT32 index = ALLOC_GetIndex(self, pFirst) + 1;
+
+    // Blocks pFirst through pLast are already linked. One CAS pushes them all.
+    do
+    {
+        head = AT_LOAD64(&self->head);
 
-    // The client block is now the new head
-    self->pHead = pClient;
+        // Point the last block's next index to head
+        AT_STORE32(&pLast->next, (INT32)HEAD_INDEX(head));
 
-    LK_UNLOCK(_hLock); 
+        // The first block is now the new head. The tag changes on every 
+        // update so a stale head cannot be swapped back in (ABA).
+    } while (!AT_CAS64(&self->head, head, MAKE_HEAD(HEAD_TAG(head) + 1, index)));
 }
 
 //----------------------------------------------------------------------------
@@ -86,29 +255,234 @@ static void ALLOC_Push(ALLOC_Allocator* self, void* pBlock)
 static void* ALLOC_Pop(ALLOC_Allocator* self)
 {
     ALLOC_Block* pBlock = NULL;
+    INT64 head;
+    UINT32 next;
 
-    LK_LOCK(_hLock);
-
-    // Is the free-list empty?
-    if (self->pHead)
+    do
     {
-        // Remove the head block
-        pBlock = self->pHead;
+        head = AT_LOAD64(&self->head);
 
-        // Set the head to the next block
-        self->pHead = self->pHead->pNext;
-    }
+        // Is the free-list empty?
+        if (HEAD_INDEX(head) == 0)
+            return NULL;
+
+        // Remove the head block and set the head to the next block. If 
+        // another thread popped the block first the tag no longer matches.
+        pBlock = ALLOC_GetBlock(self, HEAD_INDEX(head) - 1);
+        next = (UINT32)AT_LOAD32(&pBlock->next);
+    } while (!AT_CAS64(&self->head, head, MAKE_HEAD(HEAD_TAG(head) + 1, next)));
 
-    LK_UNLOCK(_hLock); 
     return GET_BLOCK_PTR(pBlock);
 } 
 
+//----------------------------------------------------------------------------
+// ALLOC_PopChain
+//----------------------------------------------------------------------------
+static UINT32 ALLOC_PopChain(ALLOC_Allocator* self, void** blocks, UINT32 count)
+{
+    ALLOC_Block* pBlock = NULL;
+    INT64 head;
+    UINT32 next;
+    UINT32 num;
+
+    for (;;)
+    {
+        head = AT_LOAD64(&self->head);
+
+        // Is the free-list empty?
+        if (HEAD_INDEX(head) == 0)
+            return 0;
+
+        // Walk up to count blocks from the head. If another thread changes the
+        // free-list meanwhile the links may be stale. The tag then no longer 
+        // matches and the walk is repeated.
+        next = HEAD_INDEX(head);
+        for (num = 0; num < count && next != 0; num++)
+        {
+            pBlock = ALLOC_FindBlock(self, next - 1);
+            if (!pBlock)
+                break;
+            blocks[num] = GET_BLOCK_PTR(pBlock);
+            next = (UINT32)AT_LOAD32(&pBlock->next);
+        }
+
+        // Remove the whole run and set the head to the block after it
+        if ((num == count || next == 0) && 
+            AT_CAS64(&self->head, head, MAKE_HEAD(HEAD_TAG(head) + 1, next)))
+        {
+            return num;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_TrackAlloc
+//----------------------------------------------------------------------------
+static void ALLOC_TrackAlloc(ALLOC_Allocator* self, void* pBlock)
+{
+    INT64 inUse, maxInUse;
+
+    // Was the block taken from a heap slab?
+    if ((const char*)pBlock < self->pPool || 
+        (const char*)pBlock >= self->pPool + (self->maxBlocks * self->blockSize))
+    {
+        AT_ADD64(&self->overflowAllocations, 1);
+    }
+
+    // Keep track of usage statistics
+    AT_ADD64(&self->allocations, 1);
+    inUse = AT_ADD64(&self->blocksInUse, 1);
+
+    // Raise the high-water mark unless another thread raised it higher
+    maxInUse = AT_LOAD64(&self->maxBlocksInUse);
+    while (inUse > maxInUse && !AT_CAS64(&self->maxBlocksInUse, maxInUse, inUse))
+        maxInUse = AT_LOAD64(&self->maxBlocksInUse);
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_MagazineAlloc
+//----------------------------------------------------------------------------
+static void* ALLOC_MagazineAlloc(ALLOC_Allocator* self, ALLOC_Magazine* mag)
+{
+    void* pBlock = NULL;
+
+    // Is a block cached within this thread's magazine?
+    if (mag->count > 0)
+    {
+        mag->stats.allocHits++;
+        return mag->blocks[--mag->count];
+    }
+
+    mag->stats.allocMisses++;
+    ALLOC_RegisterMagazines();
+
+    // Refill a batch from the shared free-list then from unused pool blocks
+    while (mag->count < ALLOC_MAGAZINE_BATCH)
+    {
+        pBlock = ALLOC_Pop(self);
+        if (!pBlock)
+            pBlock = ALLOC_TryNewBlock(self);
+        if (!pBlock)
+            break;
+        mag->blocks[mag->count++] = pBlock;
+    }
+
+    if (mag->count == 0)
+    {
+        // Out of fixed block memory
+        ASSERT();
+        return NULL;
+    }
+
+    return mag->blocks[--mag->count];
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_MagazineFree
+//----------------------------------------------------------------------------
+static void ALLOC_MagazineFree(ALLOC_Allocator* self, ALLOC_Magazine* mag, void* pBlock)
+{
+    ALLOC_RegisterMagazines();
+
+    // Is this thread's magazine full?
+    if (mag->count == ALLOC_MAGAZINE_SIZE)
+    {
+        mag->stats.freeMisses++;
+
+        // Return a batch to the shared free-list to make room
+        ALLOC_MagazineFlush(self, mag, ALLOC_MAGAZINE_BATCH);
+    }
+    else
+    {
+        mag->stats.freeHits++;
+    }
+
+    mag->blocks[mag->count++] = pBlock;
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_MagazineFlush
+//----------------------------------------------------------------------------
+static void ALLOC_MagazineFlush(ALLOC_Allocator* self, ALLOC_Magazine* mag, UINT32 num)
+{
+    ALLOC_Block* pFirst;
+    ALLOC_Block* pLast;
+    UINT32 idx;
+
+    if (num == 0 || num > mag->count)
+        return;
+
+    // Link the top num magazine blocks into a chain
+    pFirst = (ALLOC_Block*)mag->blocks[mag->count - num];
+    pLast = pFirst;
+    for (idx = mag->count - num + 1; idx < mag->count; idx++)
+    {
+        ALLOC_Block* pBlock = (ALLOC_Block*)mag->blocks[idx];
+        AT_STORE32(&pLast->next, (INT32)(ALLOC_GetIndex(self, pBlock) + 1));
+        pLast = pBlock;
+    }
+
+    // Return the whole batch to the shared free-list in one operation
+    ALLOC_PushChain(self, pFirst, pLast);
+    mag->count -= num;
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_MagazineThreadExit
+//----------------------------------------------------------------------------
+#if WIN32
+static VOID WINAPI ALLOC_MagazineThreadExit(PVOID value)
+#else
+static void ALLOC_MagazineThreadExit(void* value)
+#endif
+{
+    // Called on the exiting thread while its thread-local magazines remain 
+    // valid. Otherwise blocks cached by the thread would never be freed.
+    (void)value;
+    ALLOC_FlushMagazines();
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_CreateMagazineKey
+//----------------------------------------------------------------------------
+static void ALLOC_CreateMagazineKey(void)
+{
+    // Created once by the first ALLOC_EnableMagazine() call
+    if (!AT_CAS32(&_magazineKeyCreated, 0, 1))
+        return;
+
+#if WIN32
+    _magazineKey = FlsAlloc(ALLOC_MagazineThreadExit);
+    ASSERT_TRUE(_magazineKey != FLS_OUT_OF_INDEXES);
+#else
+    ASSERT_TRUE(pthread_key_create(&_magazineKey, ALLOC_MagazineThreadExit) == 0);
+#endif
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_RegisterMagazines
+//----------------------------------------------------------------------------
+static void ALLOC_RegisterMagazines(void)
+{
+    if (_magazineRegistered)
+        return;
+    _magazineRegistered = TRUE;
+
+    // A non-NULL value makes the OS call ALLOC_MagazineThreadExit() when the
+    // thread exits
+#if WIN32
+    FlsSetValue(_magazineKey, (PVOID)1);
+#else
+    pthread_setspecific(_magazineKey, (void*)1);
+#endif
+}
+
 //----------------------------------------------------------------------------
 // ALLOC_Init
 //----------------------------------------------------------------------------
 void ALLOC_Init()
 {
-    _hLock = LK_CREATE();
+    // Each allocator instance is lock-free. Nothing to create.
 } 
 
 //----------------------------------------------------------------------------
@@ -116,7 +490,6 @@ void ALLOC_Init()
 //----------------------------------------------------------------------------
 void ALLOC_Term()
 {
-    LK_DESTROY(_hLock);
 }
 
 //----------------------------------------------------------------------------
@@ -126,6 +499,7 @@ void* ALLOC_Alloc(ALLOC_HANDLE hAlloc, size_t size)
 {
     ALLOC_Allocator* self = NULL;
     void* pBlock = NULL;
+    INT32 magazine;
 
     ASSERT_TRUE(hAlloc);
 
@@ -135,30 +509,92 @@ void* ALLOC_Alloc(ALLOC_HANDLE hAlloc, size_t size)
     // Ensure requested size fits within memory block 
     ASSERT_TRUE(size <= self->blockSize);
 
-    // Get a block from the free-list
-    pBlock = ALLOC_Pop(self);
-
-    // If the free-list empty?
-    if (!pBlock)
+    magazine = AT_LOAD32(&self->magazine);
+    if (magazine)
     {
-        // Get a new block from the pool
-        pBlock = ALLOC_NewBlock(self);
+        // Get a block from this thread's magazine
+        pBlock = ALLOC_MagazineAlloc(self, &_magazines[magazine - 1]);
     }
-
-    if (pBlock)
+    else
     {
-        // Keep track of usage statistics
-        self->allocations++;
-        self->blocksInUse++;
-        if (self->blocksInUse > self->maxBlocksInUse)
+        // Get a block from the free-list
+        pBlock = ALLOC_Pop(self);
+
+        // If the free-list empty?
+        if (!pBlock)
         {
-            self->maxBlocksInUse = self->blocksInUse;
+            // Get a new block from the pool
+            pBlock = ALLOC_NewBlock(self);
         }
     }
 
+    if (pBlock)
+        ALLOC_TrackAlloc(self, pBlock);
+
     return GET_CLIENT_PTR(pBlock);
 } 
 
+//----------------------------------------------------------------------------
+// ALLOC_AllocBulk
+//----------------------------------------------------------------------------
+UINT32 ALLOC_AllocBulk(ALLOC_HANDLE hAlloc, size_t size, void** blocks, UINT32 count)
+{
+    ALLOC_Allocator* self = NULL;
+    ALLOC_Magazine* mag = NULL;
+    INT32 magazine;
+    UINT32 num = 0;
+    UINT32 idx;
+
+    ASSERT_TRUE(hAlloc);
+    ASSERT_TRUE(blocks || count == 0);
+
+    // Convert handle to an ALLOC_Allocator instance
+    self = (ALLOC_Allocator*)hAlloc;
+
+    // Ensure requested size fits within memory block 
+    ASSERT_TRUE(size <= self->blockSize);
+
+    // Take cached blocks from this thread's magazine first
+    magazine = AT_LOAD32(&self->magazine);
+    if (magazine)
+    {
+        mag = &_magazines[magazine - 1];
+        while (num < count && mag->count > 0)
+        {
+            mag->stats.allocHits++;
+            blocks[num++] = mag->blocks[--mag->count];
+        }
+        if (num < count)
+            mag->stats.allocMisses++;
+    }
+
+    // Remove the rest from the free-list with one operation when possible
+    while (num < count)
+    {
+        UINT32 popped = ALLOC_PopChain(self, &blocks[num], count - num);
+        if (popped == 0)
+            break;
+        num += popped;
+    }
+
+    // Then use blocks never handed out before
+    while (num < count)
+    {
+        void* pBlock = ALLOC_TryNewBlock(self);
+        if (!pBlock)
+            break;
+        blocks[num++] = pBlock;
+    }
+
+    for (idx = 0; idx < num; idx++)
+    {
+        ALLOC_TrackAlloc(self, blocks[idx]);
+        blocks[idx] = GET_CLIENT_PTR(blocks[idx]);
+    }
+
+    return num;
+}
+
 //----------------------------------------------------------------------------
 // ALLOC_Calloc
 //----------------------------------------------------------------------------
@@ -190,6 +626,7 @@ void* ALLOC_Calloc(ALLOC_HANDLE hAlloc, size_t num, size_t size)
 void ALLOC_Free(ALLOC_HANDLE hAlloc, void* pBlock)
 {
     ALLOC_Allocator* self = NULL;
+    INT32 magazine;
 
     if (!pBlock)
         return;
@@ -202,13 +639,125 @@ void ALLOC_Free(ALLOC_HANDLE hAlloc, void* pBlock)
     // Get a pointer to the block
     pBlock = GET_BLOCK_PTR(pBlock);
 
-    // Push the block onto a stack (i.e. the free-list)
-    ALLOC_Push(self, pBlock);
+    magazine = AT_LOAD32(&self->magazine);
+    if (magazine)
+    {
+        // Cache the block within this thread's magazine
+        ALLOC_MagazineFree(self, &_magazines[magazine - 1], pBlock);
+    }
+    else
+    {
+        // Push the block onto a stack (i.e. the free-list)
+        ALLOC_Push(self, pBlock);
+    }
 
     // Keep track of usage statistics
-    self->deallocations++;
-    self->blocksInUse--;
-} 
+    AT_ADD64(&self->deallocations, 1);
+    AT_ADD64(&self->blocksInUse, -1);
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_EnableMagazine
+//----------------------------------------------------------------------------
+BOOL ALLOC_EnableMagazine(ALLOC_HANDLE hAlloc)
+{
+    ALLOC_Allocator* self = NULL;
+    INT32 slot;
+
+    ASSERT_TRUE(hAlloc);
+
+    // Cast handle to an allocator instance
+    self = (ALLOC_Allocator*)hAlloc;
+
+    // Already enabled?
+    if (AT_LOAD32(&self->magazine))
+        return TRUE;
+
+    ALLOC_CreateMagazineKey();
+
+    // Assign the allocator a magazine slot within every thread
+    slot = AT_ADD32(&_magazineCount, 1) - 1;
+    if (slot >= ALLOC_MAX_MAGAZINES)
+    {
+        // Increase ALLOC_MAX_MAGAZINES
+        ASSERT();
+        return FALSE;
+    }
+
+    // Publish the owner before the allocator uses the slot. A thread flushing
+    // concurrently skips the slot until then.
+    AT_STORE_PTR(&_magazineOwners[slot], self);
+    AT_STORE32(&self->magazine, slot + 1);
+    return TRUE;
+}
 
+//----------------------------------------------------------------------------
+// ALLOC_FlushMagazines
+//----------------------------------------------------------------------------
+void ALLOC_FlushMagazines(void)
+{
+    INT32 count = AT_LOAD32(&_magazineCount);
+    INT32 slot;
+
+    if (count > ALLOC_MAX_MAGAZINES)
+        count = ALLOC_MAX_MAGAZINES;
+
+    // Return all blocks cached by the calling thread to the shared free-lists
+    for (slot = 0; slot < count; slot++)
+    {
+        ALLOC_Allocator* owner = (ALLOC_Allocator*)AT_LOAD_PTR(&_magazineOwners[slot]);
+        if (owner)
+            ALLOC_MagazineFlush(owner, &_magazines[slot], _magazines[slot].count);
+    }
+}
 
+//----------------------------------------------------------------------------
+// ALLOC_GetMagazineStats
+//----------------------------------------------------------------------------
+BOOL ALLOC_GetMagazineStats(ALLOC_HANDLE hAlloc, ALLOC_MagazineStats* stats)
+{
+    ALLOC_Allocator* self = NULL;
+    INT32 magazine;
 
+    ASSERT_TRUE(hAlloc);
+    ASSERT_TRUE(stats);
+
+    // Cast handle to an allocator instance
+    self = (ALLOC_Allocator*)hAlloc;
+
+    magazine = AT_LOAD32(&self->magazine);
+    if (!magazine)
+        return FALSE;
+
+    // Statistics for the calling thread's magazine
+    *stats = _magazines[magazine - 1].stats;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------------
+// ALLOC_GetStats
+//----------------------------------------------------------------------------
+void ALLOC_GetStats(ALLOC_HANDLE hAlloc, ALLOC_Stats* stats)
+{
+    ALLOC_Allocator* self = NULL;
+    UINT32 poolIndex;
+
+    ASSERT_TRUE(hAlloc);
+    ASSERT_TRUE(stats);
+
+    // Cast handle to an allocator instance
+    self = (ALLOC_Allocator*)hAlloc;
+
+    poolIndex = (UINT32)AT_LOAD32(&self->poolIndex);
+
+    stats->name = self->name;
+    stats->blockSize = self->blockSize;
+    stats->maxBlocks = self->maxBlocks;
+    stats->slabs = (UINT32)AT_LOAD32(&self->slabCount);
+    stats->overflowBlocks = (poolIndex > self->maxBlocks) ? poolIndex - self->maxBlocks : 0;
+    stats->overflowAllocations = (UINT64)AT_LOAD64(&self->overflowAllocations);
+    stats->blocksInUse = AT_LOAD64(&self->blocksInUse);
+    stats->maxBlocksInUse = AT_LOAD64(&self->maxBlocksInUse);
+    stats->allocations = (UINT64)AT_LOAD64(&self->allocations);
+    stats->deallocations = (UINT64)AT_LOAD64(&self->deallocations);
+}
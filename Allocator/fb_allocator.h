@@ -7,6 +7,22 @@
 // ALLOC_Init() one time at startup. ALLOC_Alloc() allocates a fixed 
 // memory block. ALLOC_Free() frees the block. 
 //
+// Optionally call ALLOC_EnableMagazine() at startup to cache blocks within a 
+// small per-thread magazine. Most allocations and frees then touch only 
+// thread-local state. Blocks move between a magazine and the shared free-list 
+// in batches. A thread's cached blocks return to the shared free-list when 
+// the thread exits, or earlier by calling ALLOC_FlushMagazines(). Size each 
+// pool to cover ALLOC_MAGAZINE_SIZE blocks per thread in addition to the 
+// blocks in use.
+//
+// Use ALLOC_DEFINE_GROWABLE to let a pool grow beyond its static blocks. When 
+// the static blocks are exhausted, slabs of blocks are allocated from the heap 
+// up to a fixed ceiling. Slab memory is retained for the life of the program 
+// and recycled through the free-list. 
+//
+// ALLOC_GetStats() returns a snapshot of the usage, high-water mark and heap 
+// overflow counters. Use them to size the static pool and spot leaks.
+//
 // #include "fb_allocator.h"
 // ALLOC_DEFINE(myAllocator, 32, 5)
 //
@@ -23,6 +39,7 @@
 
 #include <stdlib.h>
 #include "DataTypes.h"
+#include "AtomicOps.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,9 +47,14 @@ extern "C" {
 
 typedef void* ALLOC_HANDLE;
 
+// Maximum heap slabs per growable allocator
+#define ALLOC_MAX_SLABS     16
+
+// A free block. Links to the next free block by index so the free-list head 
+// fits in a single 64-bit compare-and-swap together with an ABA tag.
 typedef struct 
 {
-    void* pNext;
+    ATOMIC_INT32 next;
 } ALLOC_Block;
 
 // Use ALLOC_DEFINE to declare an ALLOC_Allocator object
@@ -43,17 +65,96 @@ typedef struct
     const size_t objectSize;
     const size_t blockSize;
     const UINT32 maxBlocks;
-    ALLOC_Block* pHead;
-    UINT16 poolIndex;
-    UINT16 blocksInUse;
-    UINT16 maxBlocksInUse;
-    UINT16 allocations;
-    UINT16 deallocations;
+
+    // Blocks per heap slab and the slab ceiling. 0 for a fixed size pool.
+    const UINT32 slabBlocks;
+    const UINT32 maxSlabs;
+
+    // Per-thread magazine slot + 1. 0 if magazines are disabled.
+    ATOMIC_INT32 magazine;
+
+    // Lock-free free-list head. Upper 32 bits are an ABA tag incremented on 
+    // every update. Lower 32 bits are the head block index + 1 (0 is empty).
+    ATOMIC_INT64 head;
+
+    // Number of pool blocks handed out at least once. Atomically bumped.
+    ATOMIC_INT32 poolIndex;
+
+    // Heap slabs installed on demand. Block indexes at or above maxBlocks 
+    // fall within the slabs.
+    char* volatile pSlabs[ALLOC_MAX_SLABS];
+
+    // Number of heap slabs allocated
+    ATOMIC_INT32 slabCount;
+
+    // Allocations served from heap slab blocks
+    ATOMIC_INT64 overflowAllocations;
+
+    // Usage statistics. Atomically updated.
+    ATOMIC_INT64 blocksInUse;
+    ATOMIC_INT64 maxBlocksInUse;
+    ATOMIC_INT64 allocations;
+    ATOMIC_INT64 deallocations;
 } ALLOC_Allocator;
 
+// Per-thread magazine statistics for one allocator
+typedef struct
+{
+    // Allocations served from the magazine
+    UINT64 allocHits;
+
+    // Allocations that refilled the magazine from the shared free-list
+    UINT64 allocMisses;
+
+    // Frees stored into the magazine
+    UINT64 freeHits;
+
+    // Frees that flushed a batch to the shared free-list
+    UINT64 freeMisses;
+} ALLOC_MagazineStats;
+
+// A statistics snapshot for one allocator. Each counter is read atomically 
+// but the counters are not read as a single consistent set.
+typedef struct
+{
+    // Allocator name and block size
+    const char* name;
+    size_t blockSize;
+
+    // Number of static pool blocks
+    UINT32 maxBlocks;
+
+    // Heap slabs allocated
+    UINT32 slabs;
+
+    // Slab blocks handed out at least once
+    UINT32 overflowBlocks;
+
+    // Allocations served from slab blocks
+    UINT64 overflowAllocations;
+
+    // Blocks currently allocated and the high-water mark
+    INT64 blocksInUse;
+    INT64 maxBlocksInUse;
+
+    // Total allocations and deallocations
+    UINT64 allocations;
+    UINT64 deallocations;
+} ALLOC_Stats;
+
+// Maximum blocks cached per thread for each allocator
+#define ALLOC_MAGAZINE_SIZE     16
+
+// Blocks exchanged with the shared free-list on each magazine refill or flush
+#define ALLOC_MAGAZINE_BATCH    (ALLOC_MAGAZINE_SIZE / 2)
+
+// Maximum allocators with magazines enabled
+#define ALLOC_MAX_MAGAZINES     8
+
 // Align fixed blocks on X-byte boundary based on CPU architecture.
-// Set value to 1, 2, 4 or 8.
-#define ALLOC_MEM_ALIGN   (1)
+// Set value to 8 or higher. A free block's ALLOC_Block::next is updated 
+// atomically and the blocks hold pointers, so smaller values are unsafe.
+#define ALLOC_MEM_ALIGN   (8)
 
 // Get the maximum between a or b
 #define ALLOC_MAX(a,b) (((a)>(b))?(a):(b))
@@ -65,7 +166,13 @@ typedef struct
 // Ensure the memory block size is: (a) is aligned on desired boundary and (b) at
 // least the size of a ALLOC_Allocator*. 
 #define ALLOC_BLOCK_SIZE(_size_) \
-    (ALLOC_MAX((ALLOC_ROUND_UP(_size_, ALLOC_MEM_ALIGN)), sizeof(ALLOC_Allocator*)))
+    (ALLOC_MAX((ALLOC_ROUND_UP(_size_, ALLOC_MEM_ALIGN)), \
+    ALLOC_ROUND_UP(sizeof(ALLOC_Allocator*), ALLOC_MEM_ALIGN)))
+
+// Number of UINT64 elements backing _objects_ blocks of _size_ bytes. The 
+// static pool is a UINT64 array so the first block starts 8-byte aligned.
+#define ALLOC_POOL_WORDS(_size_, _objects_) \
+    ((ALLOC_BLOCK_SIZE(_size_) * (_objects_) + sizeof(UINT64) - 1) / sizeof(UINT64))
 
 // Defines block memory, allocator instance and a handle. On the example below, 
 // the ALLOC_Allocator instance is myAllocatorObj and the handle is myAllocator.
@@ -74,16 +181,33 @@ typedef struct
 // _objects_ - number of fixed memory blocks 
 // e.g. ALLOC_DEFINE(myAllocator, 32, 10)
 #define ALLOC_DEFINE(_name_, _size_, _objects_) \
-    static char _name_##Memory[ALLOC_BLOCK_SIZE(_size_) * (_objects_)] = { 0 }; \
-    static ALLOC_Allocator _name_##Obj = { #_name_, _name_##Memory, _size_, \
-        ALLOC_BLOCK_SIZE(_size_), _objects_, NULL, 0, 0, 0, 0, 0 }; \
+    ALLOC_DEFINE_GROWABLE(_name_, _size_, _objects_, 0, 0)
+
+// Defines a growable allocator. Same as ALLOC_DEFINE plus:
+// _slabObjects_ - number of fixed memory blocks within each heap slab
+// _maxSlabs_ - maximum heap slabs (ALLOC_MAX_SLABS or less)
+// e.g. ALLOC_DEFINE_GROWABLE(myAllocator, 32, 10, 20, 4)
+#define ALLOC_DEFINE_GROWABLE(_name_, _size_, _objects_, _slabObjects_, _maxSlabs_) \
+    static UINT64 _name_##Memory[ALLOC_POOL_WORDS(_size_, _objects_)] = { 0 }; \
+    static ALLOC_Allocator _name_##Obj = { #_name_, (const char*)_name_##Memory, _size_, \
+        ALLOC_BLOCK_SIZE(_size_), _objects_, _slabObjects_, _maxSlabs_, \
+        0, 0, 0, { 0 }, 0, 0, 0, 0, 0, 0 }; \
     static ALLOC_HANDLE _name_ = &_name_##Obj;
 
 void ALLOC_Init(void);
 void ALLOC_Term(void);
 void* ALLOC_Alloc(ALLOC_HANDLE hAlloc, size_t size);
 void* ALLOC_Calloc(ALLOC_HANDLE hAlloc, size_t num, size_t size);
+
+// Allocate up to count blocks at once into the blocks array. A run of free 
+// blocks is removed from the free-list with one operation. Returns the number 
+// of blocks allocated, less than count if the allocator is exhausted.
+UINT32 ALLOC_AllocBulk(ALLOC_HANDLE hAlloc, size_t size, void** blocks, UINT32 count);
 void ALLOC_Free(ALLOC_HANDLE hAlloc, void* pBlock);
+BOOL ALLOC_EnableMagazine(ALLOC_HANDLE hAlloc);
+void ALLOC_FlushMagazines(void);
+BOOL ALLOC_GetMagazineStats(ALLOC_HANDLE hAlloc, ALLOC_MagazineStats* stats);
+void ALLOC_GetStats(ALLOC_HANDLE hAlloc, ALLOC_Stats* stats);
 
 #ifdef __cplusplus
 }
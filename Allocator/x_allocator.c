@@ -7,6 +7,7 @@
 static void* XALLOC_PutAllocatorPtrInBlock(void* block, ALLOC_Allocator* allocator);
 static ALLOC_Allocator* XALLOC_GetAllocatorPtrFromBlock(void* block);
 static ALLOC_Allocator* XALLOC_GetAllocator(XAllocData* self, size_t size);
+static void XALLOC_BuildLookup(XAllocData* self);
 
 //----------------------------------------------------------------------------
 // XALLOC_PutAllocatorPtrInBlock
@@ -64,12 +65,45 @@ static void* XALLOC_GetBlockPtr(void* block)
     return --pAllocatorInBlock;
 }
 
+//----------------------------------------------------------------------------
+// XALLOC_BuildLookup
+//----------------------------------------------------------------------------
+static void XALLOC_BuildLookup(XAllocData* self)
+{
+    UINT16 i = 0;
+    size_t entry;
+
+    ASSERT_TRUE(self->maxAllocators < 0xFF);
+
+    // Only one thread builds the table. Others search until it is ready.
+    if (!AT_CAS32(&self->lookupState, 0, 1))
+        return;
+
+    for (entry = 0; entry < XALLOC_LOOKUP_ENTRIES; entry++)
+    {
+        // Smallest block size mapped to this entry
+        size_t minSize = entry ? (entry - 1) * XALLOC_LOOKUP_GRANULARITY + 1 : 0;
+
+        // Advance to the first allocator able to hold minSize bytes
+        while (i < self->maxAllocators && 
+            (!self->allocators[i] || self->allocators[i]->blockSize < minSize))
+        {
+            i++;
+        }
+
+        self->lookup[entry] = (i < self->maxAllocators) ? (UINT8)(i + 1) : 0;
+    }
+
+    AT_STORE32(&self->lookupState, 2);
+}
+
 //----------------------------------------------------------------------------
 // XALLOC_GetAllocator
 //----------------------------------------------------------------------------
 static ALLOC_Allocator* XALLOC_GetAllocator(XAllocData* self, size_t size)
 {
     UINT16 i = 0;
+    size_t entry;
     ALLOC_Allocator* pAllocator = NULL;
 
     ASSERT_TRUE(self);
@@ -78,8 +112,25 @@ static ALLOC_Allocator* XALLOC_GetAllocator(XAllocData* self, size_t size)
     // Add overhead for the additional memory required.
     size += XALLOC_BLOCK_META_DATA_SIZE;
 
-    // Iterate over all allocators 
-    for (i=0; i<self->maxAllocators; i++)
+    if (AT_LOAD32(&self->lookupState) != 2)
+        XALLOC_BuildLookup(self);
+
+    // Is the size within the lookup table range?
+    entry = (size + XALLOC_LOOKUP_GRANULARITY - 1) / XALLOC_LOOKUP_GRANULARITY;
+    if (entry < XALLOC_LOOKUP_ENTRIES && AT_LOAD32(&self->lookupState) == 2)
+    {
+        // No allocator is large enough?
+        if (self->lookup[entry] == 0)
+            return NULL;
+
+        // Start at the first allocator large enough for the smallest size 
+        // within the entry. Block sizes are not granularity multiples, so 
+        // skip any allocator falling between that size and the request.
+        i = self->lookup[entry] - 1;
+    }
+
+    // Iterate over the remaining allocators 
+    for (; i<self->maxAllocators; i++)
     {
         // Can the allocator instance handle the requested size?
         if (self->allocators[i] && self->allocators[i]->blockSize >= size)
@@ -212,5 +263,22 @@ void* XALLOC_Calloc(XAllocData* self, size_t num, size_t size)
     return pMem;
 } 
 
+//----------------------------------------------------------------------------
+// XALLOC_GetStats
+//----------------------------------------------------------------------------
+UINT16 XALLOC_GetStats(XAllocData* self, ALLOC_Stats* stats, UINT16 maxStats)
+{
+    UINT16 i;
+    UINT16 count = 0;
+
+    ASSERT_TRUE(self);
+    ASSERT_TRUE(stats || maxStats == 0);
 
+    for (i = 0; i < self->maxAllocators && count < maxStats; i++)
+    {
+        if (self->allocators[i])
+            ALLOC_GetStats(self->allocators[i], &stats[count++]);
+    }
 
+    return count;
+}
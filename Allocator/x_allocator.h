@@ -29,7 +29,10 @@
 //
 // #define MAX_ALLOCATORS   (sizeof(allocators) / sizeof(allocators[0]))
 //
-// static XAllocData self = { allocators, MAX_ALLOCATORS };
+// static XAllocData self = { allocators, MAX_ALLOCATORS, { 0 }, 0 };
+//
+// The size class lookup table within XAllocData is built on the first 
+// XALLOC_Alloc() call.
 //
 // // Thin allocator wrapper function implementations call XALLOC
 // void* MYALLOC_Alloc(size_t size) { return XALLOC_Alloc(&self, size); }
@@ -57,6 +60,12 @@ extern "C" {
 // Overhead bytes added to each XALLOC memory block
 #define XALLOC_BLOCK_META_DATA_SIZE  sizeof(ALLOC_Allocator*)
 
+// Size class lookup table resolution. Block sizes up to 
+// XALLOC_LOOKUP_GRANULARITY * (XALLOC_LOOKUP_ENTRIES - 1) bytes are found in
+// constant time. Larger requests search the allocators array.
+#define XALLOC_LOOKUP_GRANULARITY    8
+#define XALLOC_LOOKUP_ENTRIES        256
+
 typedef struct
 {
     // Array of allocator instances sorted from smallest to largest block
@@ -64,6 +73,14 @@ typedef struct
 
     // Number of allocator instances stored within the allocators array
     const UINT16 maxAllocators;
+
+    // Size class lookup table built on first use. Entry n holds the index + 1
+    // of the smallest allocator whose block size exceeds 
+    // (n - 1) * XALLOC_LOOKUP_GRANULARITY bytes, or 0 if none.
+    UINT8 lookup[XALLOC_LOOKUP_ENTRIES];
+
+    // 0 = not built, 1 = building, 2 = ready
+    ATOMIC_INT32 lookupState;
 } XAllocData;
 
 void* XALLOC_Alloc(XAllocData* self, size_t size);
@@ -71,6 +88,10 @@ void XALLOC_Free(void* ptr);
 void* XALLOC_Realloc(XAllocData* self, void *ptr, size_t new_size);
 void* XALLOC_Calloc(XAllocData* self, size_t num, size_t size);
 
+// Get a statistics snapshot of each allocator. Returns the number of 
+// ALLOC_Stats entries written, at most maxStats.
+UINT16 XALLOC_GetStats(XAllocData* self, ALLOC_Stats* stats, UINT16 maxStats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,249 @@
+#include "callback.h"
+#include "fb_allocator.h"
+#include "WorkerThreadStd.h"
+#include "ThreadPoolStd.h"
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// benchmark.cpp
+// Timed multi-producer runs of the callback module. Build and run the 
+// C_AsyncCallbackBench target with optimization enabled.
+
+using namespace std;
+using namespace std::chrono;
+
+// Independent publish/subscribe channels used by the contention benchmark
+#define CHANNELS                8
+
+// Invokes made by each producer thread
+#define CONTENTION_INVOKES      200000
+
+// Maximum allowed registered callbacks per channel
+#define MAX_REGISTER            2
+
+// Invokes sent to each dispatch target by the throughput benchmark
+#define THROUGHPUT_INVOKES      20000
+
+// Maximum undelivered throughput invokes. Keeps the burst within the 
+// callback message pool ceiling.
+#define THROUGHPUT_IN_FLIGHT    128
+
+// Work done by each throughput callback, in loop iterations
+#define THROUGHPUT_WORK         2000
+
+// Declare a channel callback and a function to invoke and register it
+#define BENCH_CHANNEL(n) \
+    CB_DECLARE(Chan##n##Cb, const int*) \
+    CB_DEFINE(Chan##n##Cb, const int*, sizeof(int), MAX_REGISTER) \
+    static BOOL InvokeChan##n(const int* data) { return CB_Invoke(Chan##n##Cb, data); } \
+    static void RegisterChan##n(BOOL reg) { \
+        if (reg) CB_Register(Chan##n##Cb, ChurnCallback, NULL, NULL); \
+        else CB_Unregister(Chan##n##Cb, ChurnCallback, NULL); } \
+    static void SubscribeChan##n(void) { CB_Register(Chan##n##Cb, ChannelCallback, NULL, NULL); }
+
+typedef BOOL (*InvokeFuncType)(const int* data);
+typedef void (*RegisterFuncType)(BOOL reg);
+typedef void (*SubscribeFuncType)(void);
+
+static atomic<unsigned long> channelCallbacks(0);
+
+static void ChannelCallback(const int* data, void* userData)
+{
+    channelCallbacks.fetch_add(1, memory_order_relaxed);
+}
+
+static void ChurnCallback(const int* data, void* userData)
+{
+}
+
+BENCH_CHANNEL(0)
+BENCH_CHANNEL(1)
+BENCH_CHANNEL(2)
+BENCH_CHANNEL(3)
+BENCH_CHANNEL(4)
+BENCH_CHANNEL(5)
+BENCH_CHANNEL(6)
+BENCH_CHANNEL(7)
+
+static const InvokeFuncType invokeChan[CHANNELS] = { InvokeChan0, InvokeChan1, 
+    InvokeChan2, InvokeChan3, InvokeChan4, InvokeChan5, InvokeChan6, InvokeChan7 };
+static const RegisterFuncType registerChan[CHANNELS] = { RegisterChan0, RegisterChan1, 
+    RegisterChan2, RegisterChan3, RegisterChan4, RegisterChan5, RegisterChan6, RegisterChan7 };
+static const SubscribeFuncType subscribeChan[CHANNELS] = { SubscribeChan0, SubscribeChan1, 
+    SubscribeChan2, SubscribeChan3, SubscribeChan4, SubscribeChan5, SubscribeChan6, SubscribeChan7 };
+
+// Serializes every invoke and registration the way the former single 
+// callback module lock did. Used as the comparison baseline.
+static mutex globalLock;
+
+CB_DECLARE(WorkCb, const int*)
+CB_DEFINE(WorkCb, const int*, sizeof(int), MAX_REGISTER)
+
+static atomic<unsigned long> workCallbacks(0);
+
+static void WorkCallback(const int* data, void* userData)
+{
+    // Simulate a callback doing a fixed amount of work
+    volatile unsigned int sum = 0;
+    for (int idx = 0; idx < THROUGHPUT_WORK; idx++)
+        sum += (unsigned int)(idx * *data);
+    workCallbacks.fetch_add(1, memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// RunThroughput
+//----------------------------------------------------------------------------
+static double RunThroughput(const CB_DispatchTarget* target)
+{
+    workCallbacks.store(0);
+    CB_RegisterTarget(WorkCb, WorkCallback, target, NULL);
+
+    steady_clock::time_point start = steady_clock::now();
+    for (int count = 0; count < THROUGHPUT_INVOKES; count++)
+    {
+        while (count - (int)workCallbacks.load(memory_order_relaxed) >= THROUGHPUT_IN_FLIGHT)
+            this_thread::yield();
+        CB_Invoke(WorkCb, &count);
+    }
+    while (workCallbacks.load() < THROUGHPUT_INVOKES)
+        this_thread::yield();
+    double seconds = duration<double>(steady_clock::now() - start).count();
+
+    CB_UnregisterTarget(WorkCb, WorkCallback, target);
+    CB_Synchronize(WorkCb);
+    return THROUGHPUT_INVOKES / seconds / 1e3;
+}
+
+//----------------------------------------------------------------------------
+// BenchThroughput
+//----------------------------------------------------------------------------
+static void BenchThroughput()
+{
+    size_t cpus = WT_GetCpuCount();
+
+    WorkerThread worker("BenchWorker");
+    worker.CreateThread();
+
+    WorkerThread ringWorker("BenchRing", WorkerThread::RING_QUEUE);
+    ringWorker.CreateThread();
+
+    ThreadPool pool("BenchPool");
+    pool.CreateThreads(cpus);
+
+    cout << "Callback throughput, " << cpus << " CPUs, Kcallbacks/s" << endl;
+    cout << setw(20) << "MUTEX_QUEUE" << setw(20) << "RING_QUEUE" << setw(20) << "ThreadPool" << endl;
+    double single = RunThroughput(worker.GetDispatchTarget());
+    double ring = RunThroughput(ringWorker.GetDispatchTarget());
+    double pooled = RunThroughput(pool.GetDispatchTarget());
+    cout << setw(20) << single << setw(20) << ring << setw(20) << pooled << endl;
+    cout << "  ThreadPool steals: " << pool.GetStealCount() << endl;
+
+    pool.ExitThreads();
+    ringWorker.ExitThread();
+    worker.ExitThread();
+}
+
+//----------------------------------------------------------------------------
+// RunContention
+//----------------------------------------------------------------------------
+static double RunContention(size_t producers, BOOL sharedChannel, BOOL useGlobalLock)
+{
+    atomic<bool> stop(false);
+    vector<thread> threads;
+
+    // One thread registers and unregisters on every channel throughout the run
+    thread churn([&] {
+        BOOL reg = TRUE;
+        while (!stop.load())
+        {
+            for (size_t ch = 0; ch < CHANNELS; ch++)
+            {
+                if (useGlobalLock)
+                {
+                    lock_guard<mutex> lk(globalLock);
+                    registerChan[ch](reg);
+                }
+                else
+                {
+                    registerChan[ch](reg);
+                }
+            }
+            reg = !reg;
+            this_thread::yield();
+        }
+    });
+
+    steady_clock::time_point start = steady_clock::now();
+    for (size_t idx = 0; idx < producers; idx++)
+    {
+        threads.emplace_back([=] {
+            InvokeFuncType invoke = invokeChan[sharedChannel ? 0 : idx % CHANNELS];
+            int data = (int)idx;
+            for (int count = 0; count < CONTENTION_INVOKES; count++)
+            {
+                if (useGlobalLock)
+                {
+                    lock_guard<mutex> lk(globalLock);
+                    invoke(&data);
+                }
+                else
+                {
+                    invoke(&data);
+                }
+            }
+        });
+    }
+    for (size_t idx = 0; idx < producers; idx++)
+        threads[idx].join();
+    double seconds = duration<double>(steady_clock::now() - start).count();
+
+    stop.store(true);
+    churn.join();
+
+    // Unregister any churn registration left behind
+    for (size_t ch = 0; ch < CHANNELS; ch++)
+        registerChan[ch](FALSE);
+
+    return (producers * CONTENTION_INVOKES) / seconds / 1e6;
+}
+
+//----------------------------------------------------------------------------
+// BenchContention
+//----------------------------------------------------------------------------
+static void BenchContention()
+{
+    for (size_t ch = 0; ch < CHANNELS; ch++)
+        subscribeChan[ch]();
+
+    cout << "Invoke contention, " << CHANNELS << " channels, " << 
+        thread::hardware_concurrency() << " CPUs, Minvokes/s" << endl;
+    cout << setw(12) << "producers" << setw(14) << "own channel" << 
+        setw(14) << "global lock" << setw(16) << "shared channel" << endl;
+    cout << fixed << setprecision(2);
+    for (size_t producers = 1; producers <= CHANNELS; producers *= 2)
+    {
+        double own = RunContention(producers, FALSE, FALSE);
+        double global = RunContention(producers, FALSE, TRUE);
+        double shared = RunContention(producers, TRUE, FALSE);
+        cout << setw(12) << producers << setw(14) << own << 
+            setw(14) << global << setw(16) << shared << endl;
+    }
+}
+
+int main()
+{
+    ALLOC_Init();
+    CB_Init();
+
+    BenchContention();
+    BenchThroughput();
+
+    CB_Term();
+    ALLOC_Term();
+    return 0;
+}
@@ -1,41 +1,514 @@
 #include "callback.h"
 #include "DataTypes.h"
+#include "AtomicOps.h"
 #include "Fault.h"
+#include <stddef.h>
 #include <string.h>
 
-// Define USE_LOCK to use the default lock implementation
-#define USE_LOCKS
-#ifdef USE_LOCKS
-    #include "LockGuard.h"
-    static LOCK_HANDLE _hLock;
-#else
-    #pragma message("WARNING: Define software lock.")
-    typedef int LOCK_HANDLE;
-    static LOCK_HANDLE _hLock;
-
-    #define LK_CREATE()     (1)
-    #define LK_DESTROY(h)  
-    #define LK_LOCK(h)    
-    #define LK_UNLOCK(h)  
-#endif
-
 // Define USE_CALLBACK_ALLOCATOR to use the fixed block allocator instead of heap
 #define USE_CALLBACK_ALLOCATOR
 #ifdef USE_CALLBACK_ALLOCATOR
     #define XALLOC(size)    CBALLOC_Alloc(size)
     #define XFREE(ptr)      CBALLOC_Free(ptr)
+    #define XALLOC_MSG()    CBALLOC_AllocMsg()
+    #define XALLOC_MSGS(msgs, count)    CBALLOC_AllocMsgs(msgs, count)
+    #define XFREE_MSG(ptr)  CBALLOC_FreeMsg(ptr)
 #else
     #include <stdlib.h>
     #define XALLOC(size)    malloc(size)
     #define XFREE(ptr)      free(ptr)
+    #define XALLOC_MSG()    malloc(sizeof(CB_CallbackMsg))
+    #define XALLOC_MSGS(msgs, count)    0
+    #define XFREE_MSG(ptr)  free(ptr)
 #endif
 
-static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_t cbDataSize);
+// CB_CallbackMsg::cbFlags values
+#define CB_MSG_FLAG_INLINE      0x0001  // Fixed size message from XALLOC_MSG()
+#define CB_MSG_FLAG_SHARED      0x0002  // Callback data within a CB_SharedData block
+#define CB_MSG_FLAG_CONFLATE    0x0004  // CB_Conflate trigger. Carries no callback data.
+
+// CB_Conflate::cbState encoding
+#define CB_CONFLATE_QUEUED          0x1
+#define CB_CONFLATE_STATE(gen)      ((INT32)((UINT32)(gen) << 1))
+#define CB_CONFLATE_GEN(state)      ((INT32)((UINT32)(state) >> 1))
+
+// Messages taken from the allocator per bulk allocation by CB_InvokeBatch()
+#define CB_BATCH_ALLOC_SIZE     16
+
+// Pause iterations before a spin wait yields the CPU. A preempted or lower 
+// priority lock holder pinned to the same CPU then gets to run.
+#define CB_SPIN_LIMIT           64
+
+// Reference counted callback data shared by all asynchronous subscribers of 
+// one invoke. The data is either a single copy stored within the block or a 
+// publisher owned buffer. The last subscriber to finish frees the block and 
+// calls the optional release function.
+typedef struct CB_SharedData
+{
+    ATOMIC_INT32 refCount;
+
+    // The callback data. Points to payload or to a publisher owned buffer.
+    const void* cbData;
+
+    // Optional function called when the last reference is released
+    CB_ReleaseFuncType cbReleaseFunc;
+    void* cbReleaseUserData;
+
+    // Callback data storage. Must be the last member.
+    union
+    {
+        char data[CB_INLINE_DATA_SIZE];
+        double align;
+    } payload;
+} CB_SharedData;
+
+#define CB_SHARED_HEADER_SIZE   offsetof(CB_SharedData, payload)
+
+static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_t cbDataSize,
+    CB_SharedData* cbShared, const CB_InvokeParams* cbParams);
+static BOOL CB_DispatchBatchCallback(const CB_Info* cbInfo, const void* cbData, size_t cbDataSize,
+    size_t cbCount);
+static CB_CallbackMsg* CB_AllocMsg(size_t cbDataSize);
+static size_t CB_AllocMsgs(CB_CallbackMsg** cbMsgs, size_t cbCount, size_t cbDataSize);
+static void CB_FreeMsg(CB_CallbackMsg* cbMsg);
+static CB_SharedData* CB_AllocShared(const void* cbData, size_t cbDataSize);
+static CB_SharedData* CB_AllocBorrowed(const void* cbData, CB_ReleaseFuncType cbReleaseFunc,
+    void* cbReleaseUserData);
+static void CB_ReleaseShared(CB_SharedData* cbShared);
+static size_t CB_CountAsync(const CB_Info* cbInfo, size_t cbInfoLen);
+static BOOL CB_DispatchAll(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData,
+    size_t cbDataSize, CB_SharedData* cbShared, const CB_InvokeParams* cbParams);
+static INT32 CB_ReadBegin(CB_Sync* cbSync);
+static void CB_ListSync(CB_Sync* cbSync);
+static void CB_WriteLock(CB_Sync* cbSync);
+static void CB_WriteUnlock(CB_Sync* cbSync);
+static void CB_WriteInfo(CB_Sync* cbSync, CB_Info* cbInfo, CB_CallbackFuncType cbFunc,
+    CB_DispatchCallbackFuncType cbDispatchFunc, const CB_DispatchTarget* cbTarget, void* cbUserData,
+    INT32 cbPriority, CB_Conflate* cbConflate, INT32 cbGeneration, BOOL cbBatch);
+static UINT16 CB_GetPriority(const CB_Info* cbInfo, const CB_InvokeParams* cbParams);
+static BOOL CB_Post(const CB_Info* cbInfo, CB_CallbackMsg* cbMsg);
+static BOOL CB_PostConflate(const CB_Info* cbInfo, CB_CallbackMsg* cbMsg);
+static void CB_InvokeConflate(CB_CallbackMsg* cbTrigger, BOOL cbInvoke);
+static void CB_WithdrawConflate(CB_Conflate* cbConflate);
+static void CB_Backoff(UINT32* spins);
+
+// Every callback definition registered at least once. Walked by 
+// CB_SynchronizeAll(). Definitions are static and never removed.
+static CB_Sync* volatile cbSyncList = NULL;
+
+//----------------------------------------------------------------------------
+// CB_Backoff
+//----------------------------------------------------------------------------
+static void CB_Backoff(UINT32* spins)
+{
+    // Spin briefly, then yield on every later iteration of the wait
+    if (*spins < CB_SPIN_LIMIT)
+    {
+        (*spins)++;
+        AT_PAUSE();
+    }
+    else
+    {
+        AT_YIELD();
+    }
+}
+
+//----------------------------------------------------------------------------
+// CB_ReadBegin
+//----------------------------------------------------------------------------
+static INT32 CB_ReadBegin(CB_Sync* cbSync)
+{
+    INT32 seq;
+    UINT32 spins = 0;
+
+    // Wait for any in progress registration change to complete
+    while ((seq = AT_LOAD32(&cbSync->seq)) & 1)
+    {
+        // A writer holds the sequence odd only while storing one CB_Info, but
+        // may be preempted while doing so
+        CB_Backoff(&spins);
+    }
+
+    return seq;
+}
+
+//----------------------------------------------------------------------------
+// CB_WriteLock
+//----------------------------------------------------------------------------
+static void CB_WriteLock(CB_Sync* cbSync)
+{
+    UINT32 spins = 0;
+
+    // Registration changes are short and never call user code. Spin on the 
+    // callback definition's own lock.
+    while (!AT_CAS32(&cbSync->lock, 0, 1))
+        CB_Backoff(&spins);
+}
+
+//----------------------------------------------------------------------------
+// CB_WriteUnlock
+//----------------------------------------------------------------------------
+static void CB_WriteUnlock(CB_Sync* cbSync)
+{
+    AT_STORE32(&cbSync->lock, 0);
+}
+
+//----------------------------------------------------------------------------
+// CB_ListSync
+//----------------------------------------------------------------------------
+static void CB_ListSync(CB_Sync* cbSync)
+{
+    CB_Sync* cbNext;
+
+    // Caller must hold the registration lock
+    if (cbSync->listed)
+        return;
+    cbSync->listed = 1;
+
+    // Lock-free push. The list is only ever walked, never unlinked.
+    do
+    {
+        cbNext = (CB_Sync*)AT_LOAD_PTR(&cbSyncList);
+        cbSync->next = cbNext;
+    } while (!AT_CAS_PTR(&cbSyncList, cbNext, cbSync));
+}
+
+//----------------------------------------------------------------------------
+// CB_WriteInfo
+//----------------------------------------------------------------------------
+static void CB_WriteInfo(CB_Sync* cbSync, CB_Info* cbInfo, CB_CallbackFuncType cbFunc,
+    CB_DispatchCallbackFuncType cbDispatchFunc, const CB_DispatchTarget* cbTarget, void* cbUserData,
+    INT32 cbPriority, CB_Conflate* cbConflate, INT32 cbGeneration, BOOL cbBatch)
+{
+    // Caller must hold the registration lock. An odd sequence tells lock-free
+    // readers the CB_Info array is changing.
+    AT_ADD32(&cbSync->seq, 1);
+
+    AT_STORE_PTR(&cbInfo->cbFunc, cbFunc);
+    AT_STORE_PTR(&cbInfo->cbDispatchFunc, cbDispatchFunc);
+    AT_STORE_PTR(&cbInfo->cbTarget, cbTarget);
+    AT_STORE_PTR(&cbInfo->cbUserData, cbUserData);
+    AT_STORE32(&cbInfo->cbPriority, cbPriority);
+    AT_STORE_PTR(&cbInfo->cbConflate, cbConflate);
+    AT_STORE32(&cbInfo->cbGeneration, cbGeneration);
+    AT_STORE32(&cbInfo->cbBatch, cbBatch);
+
+    AT_ADD32(&cbSync->seq, 1);
+}
+
+//----------------------------------------------------------------------------
+// CB_AllocMsg
+//----------------------------------------------------------------------------
+static CB_CallbackMsg* CB_AllocMsg(size_t cbDataSize)
+{
+    CB_CallbackMsg* cbMsg = NULL;
+
+    // Does the callback data fit inline within a fixed size message?
+    if (cbDataSize <= CB_INLINE_DATA_SIZE)
+    {
+        cbMsg = (CB_CallbackMsg*)XALLOC_MSG();
+        if (cbMsg)
+            cbMsg->cbFlags = CB_MSG_FLAG_INLINE;
+    }
+    else
+    {
+        // Allocate one block for the message header and callback data
+        cbMsg = (CB_CallbackMsg*)XALLOC(CB_MSG_HEADER_SIZE + cbDataSize);
+        if (cbMsg)
+            cbMsg->cbFlags = 0;
+    }
+
+    return cbMsg;
+}
+
+//----------------------------------------------------------------------------
+// CB_AllocMsgs
+//----------------------------------------------------------------------------
+static size_t CB_AllocMsgs(CB_CallbackMsg** cbMsgs, size_t cbCount, size_t cbDataSize)
+{
+    size_t num = 0;
+    size_t idx;
+
+    // Take fixed size messages from the pool with one bulk allocation
+    if (cbDataSize <= CB_INLINE_DATA_SIZE)
+    {
+        num = XALLOC_MSGS((void**)cbMsgs, (UINT32)cbCount);
+        for (idx = 0; idx < num; idx++)
+            cbMsgs[idx]->cbFlags = CB_MSG_FLAG_INLINE;
+    }
+
+    // Allocate any remaining messages one at a time
+    while (num < cbCount)
+    {
+        cbMsgs[num] = CB_AllocMsg(cbDataSize);
+        if (!cbMsgs[num])
+            break;
+        num++;
+    }
+
+    return num;
+}
+
+//----------------------------------------------------------------------------
+// CB_FreeMsg
+//----------------------------------------------------------------------------
+static void CB_FreeMsg(CB_CallbackMsg* cbMsg)
+{
+    // Drop this message's reference to shared callback data
+    if (cbMsg->cbFlags & CB_MSG_FLAG_SHARED)
+        CB_ReleaseShared(cbMsg->cbInline.shared);
+
+    if (cbMsg->cbFlags & CB_MSG_FLAG_INLINE)
+        XFREE_MSG(cbMsg);
+    else
+        XFREE(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// CB_AllocShared
+//----------------------------------------------------------------------------
+static CB_SharedData* CB_AllocShared(const void* cbData, size_t cbDataSize)
+{
+    CB_SharedData* cbShared = NULL;
+
+    // Allocate one block for the reference count and callback data
+    cbShared = (CB_SharedData*)XALLOC(CB_SHARED_HEADER_SIZE + cbDataSize);
+    if (cbShared)
+    {
+        // The dispatching thread holds the initial reference
+        cbShared->refCount = 1;
+        cbShared->cbData = cbShared->payload.data;
+        cbShared->cbReleaseFunc = NULL;
+        cbShared->cbReleaseUserData = NULL;
+
+        // Bitwise copy callback data argument one time for all subscribers
+        memcpy(cbShared->payload.data, cbData, cbDataSize);
+    }
+
+    return cbShared;
+}
+
+//----------------------------------------------------------------------------
+// CB_AllocBorrowed
+//----------------------------------------------------------------------------
+static CB_SharedData* CB_AllocBorrowed(const void* cbData, CB_ReleaseFuncType cbReleaseFunc,
+    void* cbReleaseUserData)
+{
+    CB_SharedData* cbShared = NULL;
+
+    // Allocate a reference count block only. Callback data is not copied.
+    cbShared = (CB_SharedData*)XALLOC(CB_SHARED_HEADER_SIZE);
+    if (cbShared)
+    {
+        // The dispatching thread holds the initial reference
+        cbShared->refCount = 1;
+        cbShared->cbData = cbData;
+        cbShared->cbReleaseFunc = cbReleaseFunc;
+        cbShared->cbReleaseUserData = cbReleaseUserData;
+    }
+
+    return cbShared;
+}
+
+//----------------------------------------------------------------------------
+// CB_ReleaseShared
+//----------------------------------------------------------------------------
+static void CB_ReleaseShared(CB_SharedData* cbShared)
+{
+    ASSERT_TRUE(cbShared);
+
+    // Free the shared callback data when the last reference is released
+    if (AT_ADD32(&cbShared->refCount, -1) == 0)
+    {
+        // Return a borrowed buffer to the publisher
+        if (cbShared->cbReleaseFunc)
+            cbShared->cbReleaseFunc(cbShared->cbData, cbShared->cbReleaseUserData);
+
+        XFREE(cbShared);
+    }
+}
+
+//----------------------------------------------------------------------------
+// CB_CountAsync
+//----------------------------------------------------------------------------
+static size_t CB_CountAsync(const CB_Info* cbInfo, size_t cbInfoLen)
+{
+    size_t count = 0;
+
+    for (size_t idx = 0; idx<cbInfoLen; idx++)
+    {
+        // Registered with an OS task dispatch function?
+        if (cbInfo[idx].cbFunc && (cbInfo[idx].cbDispatchFunc || cbInfo[idx].cbTarget))
+            count++;
+    }
+
+    return count;
+}
+
+//----------------------------------------------------------------------------
+// CB_GetPriority
+//----------------------------------------------------------------------------
+static UINT16 CB_GetPriority(const CB_Info* cbInfo, const CB_InvokeParams* cbParams)
+{
+    // The higher of the registration and invoke priorities
+    INT32 priority = cbInfo->cbPriority;
+    if (cbParams && cbParams->cbPriority > priority)
+        priority = cbParams->cbPriority;
+    return (UINT16)priority;
+}
+
+//----------------------------------------------------------------------------
+// CB_Post
+//----------------------------------------------------------------------------
+static BOOL CB_Post(const CB_Info* cbInfo, CB_CallbackMsg* cbMsg)
+{
+    // Pass the target's context to a context carrying dispatch function
+    if (cbInfo->cbTarget)
+        return cbInfo->cbTarget->cbDispatchFunc(cbMsg, cbInfo->cbTarget->cbContext);
+    return cbInfo->cbDispatchFunc(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// CB_PostConflate
+//----------------------------------------------------------------------------
+static BOOL CB_PostConflate(const CB_Info* cbInfo, CB_CallbackMsg* cbMsg)
+{
+    CB_Conflate* cbConflate = cbInfo->cbConflate;
+    INT32 cbGen = cbInfo->cbGeneration;
+    CB_CallbackMsg* cbPending = cbMsg;
+    CB_CallbackMsg* cbTrigger;
+    CB_CallbackMsg* cbOld;
+    UINT32 cbKey = cbMsg->cbKey;
+    UINT16 cbPriority = cbMsg->cbPriority;
+    INT32 cbState;
+
+    // Data messages are never dispatched. cbMsgId records the generation of 
+    // the registration that owns the data.
+    cbMsg->cbMsgId = cbGen;
+
+    // Publish the newest data. Once exchanged, another invoke may free cbMsg.
+    cbOld = (CB_CallbackMsg*)AT_XCHG_PTR(&cbConflate->cbLatest, cbMsg);
+    if (cbOld)
+    {
+        // Undelivered data replaced. A queued trigger delivers cbMsg instead.
+        CB_FreeMsg(cbOld);
+    }
+
+    for (;;)
+    {
+        cbState = AT_LOAD32(&cbConflate->cbState);
+
+        // Snapshot taken before the registration was removed. Withdraw the data.
+        if (CB_CONFLATE_GEN(cbState) != cbGen)
+        {
+            if (AT_CAS_PTR(&cbConflate->cbLatest, cbMsg, NULL))
+                CB_FreeMsg(cbMsg);
+            return FALSE;
+        }
+
+        // Queue a trigger unless one is already queued
+        if (cbState & CB_CONFLATE_QUEUED)
+            return TRUE;
+        if (!AT_CAS32(&cbConflate->cbState, cbState, cbState | CB_CONFLATE_QUEUED))
+            continue;
+
+        cbTrigger = CB_AllocMsg(0);
+        if (cbTrigger)
+        {
+            cbTrigger->cbFunc = cbInfo->cbFunc;
+            cbTrigger->cbData = NULL;
+            cbTrigger->cbUserData = cbConflate;
+            cbTrigger->cbNext = NULL;
+            cbTrigger->cbTimestamp = 0;
+            cbTrigger->cbMsgId = 0;
+            cbTrigger->cbKey = cbKey;
+            cbTrigger->cbPriority = cbPriority;
+            cbTrigger->cbFlags |= CB_MSG_FLAG_CONFLATE;
+            cbTrigger->cbInline.generation = cbGen;
+
+            if (CB_Post(cbInfo, cbTrigger))
+                return TRUE;
+            CB_FreeMsg(cbTrigger);
+        }
+
+        // Target task queue full. Withdraw the pending data unless a newer 
+        // invoke replaced it; that invoke expects a trigger so post again.
+        AT_CAS32(&cbConflate->cbState, cbState | CB_CONFLATE_QUEUED, cbState);
+        if (AT_CAS_PTR(&cbConflate->cbLatest, cbPending, NULL))
+        {
+            CB_FreeMsg(cbPending);
+            return FALSE;
+        }
+        cbPending = (CB_CallbackMsg*)AT_LOAD_PTR(&cbConflate->cbLatest);
+        if (!cbPending)
+            return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------------
+// CB_InvokeConflate
+//----------------------------------------------------------------------------
+static void CB_InvokeConflate(CB_CallbackMsg* cbTrigger, BOOL cbInvoke)
+{
+    CB_Conflate* cbConflate = (CB_Conflate*)cbTrigger->cbUserData;
+    INT32 cbState = CB_CONFLATE_STATE(cbTrigger->cbInline.generation);
+    CB_CallbackMsg* cbMsg;
+
+    CB_FreeMsg(cbTrigger);
+
+    // Allow the next invoke to queue a trigger before taking the data so an
+    // invoke racing with this callback is never lost. Fails if the 
+    // registration was removed after the trigger was queued.
+    if (!AT_CAS32(&cbConflate->cbState, cbState | CB_CONFLATE_QUEUED, cbState))
+        return;
+
+    // A trigger queued by a racing invoke may find the data already taken
+    cbMsg = (CB_CallbackMsg*)AT_XCHG_PTR(&cbConflate->cbLatest, NULL);
+    if (!cbMsg)
+        return;
+
+    if (cbMsg->cbMsgId != CB_CONFLATE_GEN(cbState))
+    {
+        // Registration replaced while this callback ran. Return data owned by
+        // the new registration to its own trigger.
+        if (cbMsg->cbMsgId == CB_CONFLATE_GEN(AT_LOAD32(&cbConflate->cbState)) &&
+            AT_CAS_PTR(&cbConflate->cbLatest, NULL, cbMsg))
+            return;
+        cbInvoke = FALSE;
+    }
+
+    if (cbInvoke)
+        cbMsg->cbFunc(cbMsg->cbData, cbMsg->cbUserData);
+    CB_FreeMsg(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// CB_WithdrawConflate
+//----------------------------------------------------------------------------
+static void CB_WithdrawConflate(CB_Conflate* cbConflate)
+{
+    INT32 cbState;
+    CB_CallbackMsg* cbMsg;
+
+    // Caller must hold the registration lock. Advance the generation so a 
+    // trigger still queued on the old target does nothing, then discard the
+    // undelivered data.
+    do
+    {
+        cbState = AT_LOAD32(&cbConflate->cbState);
+    } while (!AT_CAS32(&cbConflate->cbState, cbState,
+        CB_CONFLATE_STATE(CB_CONFLATE_GEN(cbState) + 1)));
+
+    cbMsg = (CB_CallbackMsg*)AT_XCHG_PTR(&cbConflate->cbLatest, NULL);
+    if (cbMsg)
+        CB_FreeMsg(cbMsg);
+}
 
 //----------------------------------------------------------------------------
 // CB_DispatchCallback
 //----------------------------------------------------------------------------
-static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_t cbDataSize)
+static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_t cbDataSize,
+    CB_SharedData* cbShared, const CB_InvokeParams* cbParams)
 {
     BOOL success = FALSE;
     BOOL dispatchSuccess = FALSE;
@@ -45,7 +518,7 @@ static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_
     ASSERT_TRUE(cbInfo);
 
     // Is an OS task dispatch function defined? 
-    if (cbInfo->cbDispatchFunc == NULL)
+    if (cbInfo->cbDispatchFunc == NULL && cbInfo->cbTarget == NULL)
     {
         ASSERT_TRUE(cbInfo->cbFunc);
 
@@ -54,20 +527,23 @@ static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_
         return TRUE;
     }
 
-    // Is there callback data?
-    if (cbDataSize > 0)
-    {
-        // Allocate fixed block memory for callback argument data
-        cbDataCopy = XALLOC(cbDataSize);
-    }
-
-    // Allocate fixed block memory for a callback message
-    cbMsg = (CB_CallbackMsg*)XALLOC(sizeof(CB_CallbackMsg));
+    // Allocate fixed block memory for the callback message and argument data.
+    // Shared callback data is referenced, not copied, so only a message is needed.
+    cbMsg = CB_AllocMsg(cbShared ? 0 : cbDataSize);
     if (cbMsg)
     {
-        if (cbDataCopy)
+        if (cbShared)
+        {
+            // Take a reference to the callback data shared by all subscribers
+            AT_ADD32(&cbShared->refCount, 1);
+            cbMsg->cbInline.shared = cbShared;
+            cbMsg->cbFlags |= CB_MSG_FLAG_SHARED;
+            cbDataCopy = (void*)cbShared->cbData;
+        }
+        else if (cbDataSize > 0)
         {
-            // Bitwise copy callback data argument
+            // Bitwise copy callback data argument into the message
+            cbDataCopy = cbMsg->cbInline.data;
             memcpy(cbDataCopy, cbData, cbDataSize);
         }
 
@@ -75,9 +551,18 @@ static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_
         cbMsg->cbFunc = cbInfo->cbFunc;
         cbMsg->cbData = cbDataCopy;
         cbMsg->cbUserData = cbInfo->cbUserData;
+        cbMsg->cbNext = NULL;
+        cbMsg->cbTimestamp = 0;
+        cbMsg->cbMsgId = 0;
+        cbMsg->cbKey = cbParams ? cbParams->cbKey : 0;
+        cbMsg->cbPriority = CB_GetPriority(cbInfo, cbParams);
+
+        // A conflating subscriber takes ownership of the message
+        if (cbInfo->cbConflate)
+            return CB_PostConflate(cbInfo, cbMsg);
 
         // Dispatch the callback message onto the OS task
-        dispatchSuccess = cbInfo->cbDispatchFunc(cbMsg);
+        dispatchSuccess = CB_Post(cbInfo, cbMsg);
 
         // Did the message get dispatched onto the OS task?
         if (dispatchSuccess)
@@ -85,12 +570,14 @@ static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_
             // Success! Callback dispatched to target task.
             success = TRUE;
         }
+        else
+        {
+            // Target task queue full. Message was not queued.
+            CB_FreeMsg(cbMsg);
+        }
     }
     else
     {
-        CBALLOC_Free(cbMsg);
-        CBALLOC_Free(cbDataCopy);
-
         // Out of memory
         ASSERT();
     }
@@ -98,12 +585,120 @@ static BOOL CB_DispatchCallback(const CB_Info* cbInfo, const void* cbData, size_
     return success;
 } 
 
+//----------------------------------------------------------------------------
+// CB_DispatchBatchCallback
+//----------------------------------------------------------------------------
+static BOOL CB_DispatchBatchCallback(const CB_Info* cbInfo, const void* cbData, size_t cbDataSize,
+    size_t cbCount)
+{
+    CB_CallbackMsg* cbMsgs[CB_BATCH_ALLOC_SIZE];
+    CB_CallbackMsg* cbHead = NULL;
+    CB_CallbackMsg* cbTail = NULL;
+    CB_CallbackMsg* cbMsg = NULL;
+    BOOL success = FALSE;
+    size_t idx = 0;
+    size_t num, allocated, msgIdx;
+
+    ASSERT_TRUE(cbInfo);
+    ASSERT_TRUE(cbInfo->cbFunc);
+
+    // Is an OS task dispatch function defined? 
+    if (cbInfo->cbDispatchFunc == NULL && cbInfo->cbTarget == NULL)
+    {
+        // No OS task dispatch function. Synchronously invoke callback function
+        // once for each element.
+        for (idx = 0; idx < cbCount; idx++)
+            cbInfo->cbFunc((const char*)cbData + (idx * cbDataSize), cbInfo->cbUserData);
+        return TRUE;
+    }
+
+    // A conflating subscriber only receives the newest element
+    if (cbInfo->cbConflate)
+    {
+        return CB_DispatchCallback(cbInfo, (const char*)cbData + ((cbCount - 1) * cbDataSize),
+            cbDataSize, NULL, NULL);
+    }
+
+    while (idx < cbCount)
+    {
+        // Allocate the next group of messages at once
+        num = cbCount - idx;
+        if (num > CB_BATCH_ALLOC_SIZE)
+            num = CB_BATCH_ALLOC_SIZE;
+        allocated = CB_AllocMsgs(cbMsgs, num, cbDataSize);
+
+        for (msgIdx = 0; msgIdx < allocated; msgIdx++, idx++)
+        {
+            cbMsg = cbMsgs[msgIdx];
+
+            // Bitwise copy the element into the message
+            memcpy(cbMsg->cbInline.data, (const char*)cbData + (idx * cbDataSize), cbDataSize);
+
+            cbMsg->cbFunc = cbInfo->cbFunc;
+            cbMsg->cbData = cbMsg->cbInline.data;
+            cbMsg->cbUserData = cbInfo->cbUserData;
+            cbMsg->cbNext = NULL;
+            cbMsg->cbTimestamp = 0;
+            cbMsg->cbMsgId = 0;
+            cbMsg->cbKey = 0;
+            cbMsg->cbPriority = CB_GetPriority(cbInfo, NULL);
+
+            if (cbInfo->cbBatch)
+            {
+                // Build a chain of callback messages linked by cbNext
+                if (cbTail)
+                    cbTail->cbNext = cbMsg;
+                else
+                    cbHead = cbMsg;
+                cbTail = cbMsg;
+            }
+            else if (CB_Post(cbInfo, cbMsg))
+            {
+                // A dispatch function without chain support gets one message 
+                // per call
+                success = TRUE;
+            }
+            else
+            {
+                // Target task queue full
+                CB_FreeMsg(cbMsg);
+            }
+        }
+
+        if (allocated < num)
+        {
+            // Out of memory
+            ASSERT();
+            break;
+        }
+    }
+
+    if (!cbHead)
+        return success;
+
+    // Dispatch the entire chain onto the OS task with one call
+    if (CB_Post(cbInfo, cbHead))
+        return TRUE;
+
+    // Target task queue full. No message was queued.
+    while (cbHead)
+    {
+        cbMsg = cbHead;
+        cbHead = cbHead->cbNext;
+        CB_FreeMsg(cbMsg);
+    }
+    return FALSE;
+}
+
 //----------------------------------------------------------------------------
 // CB_Init
 //----------------------------------------------------------------------------
 void CB_Init(void)
 {
-    _hLock = LK_CREATE();
+    // Each callback definition owns its synchronization state. Nothing to create.
+#ifdef USE_CALLBACK_ALLOCATOR
+    CBALLOC_Init();
+#endif
 }
 
 //----------------------------------------------------------------------------
@@ -111,7 +706,6 @@ void CB_Init(void)
 //----------------------------------------------------------------------------
 void CB_Term(void)
 {
-    LK_DESTROY(_hLock);
 }
 
 //----------------------------------------------------------------------------
@@ -122,30 +716,64 @@ void CB_TargetInvoke(const CB_CallbackMsg* cbMsg)
     ASSERT_TRUE(cbMsg);
     ASSERT_TRUE(cbMsg->cbFunc);
 
+    // A conflating trigger invokes the newest data of its registration
+    if (cbMsg->cbFlags & CB_MSG_FLAG_CONFLATE)
+    {
+        CB_InvokeConflate((CB_CallbackMsg*)cbMsg, TRUE);
+        return;
+    }
+
     // Invoke callback function with the callback data
     cbMsg->cbFunc(cbMsg->cbData, cbMsg->cbUserData);
 
-    // Free data sent through OS queue
-    XFREE((void*)cbMsg->cbData);
-    XFREE((void*)cbMsg);
+    // Free the message and data sent through OS queue
+    CB_FreeMsg((CB_CallbackMsg*)cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// CB_TargetDiscard
+//----------------------------------------------------------------------------
+void CB_TargetDiscard(const CB_CallbackMsg* cbMsg)
+{
+    ASSERT_TRUE(cbMsg);
+
+    // A conflating trigger discards the newest data of its registration
+    if (cbMsg->cbFlags & CB_MSG_FLAG_CONFLATE)
+    {
+        CB_InvokeConflate((CB_CallbackMsg*)cbMsg, FALSE);
+        return;
+    }
+
+    // Free the message and data without invoking the callback
+    CB_FreeMsg((CB_CallbackMsg*)cbMsg);
 }
 
 //----------------------------------------------------------------------------
 // _CB_AddCallback
 //----------------------------------------------------------------------------
-BOOL _CB_AddCallback(CB_Info* cbInfo,
+BOOL _CB_AddCallback(CB_Sync* cbSync,
+    CB_Info* cbInfo,
     size_t cbInfoLen,
     CB_CallbackFuncType cbFunc,
     CB_DispatchCallbackFuncType cbDispatchFunc,
-    void* cbUserData)
+    const CB_DispatchTarget* cbTarget,
+    void* cbUserData,
+    INT32 cbPriority,
+    CB_Conflate* cbConflate,
+    BOOL cbBatch)
 {
     BOOL success = FALSE;
 
+    ASSERT_TRUE(cbSync);
     ASSERT_TRUE(cbInfo);
     ASSERT_TRUE(cbInfoLen > 0);
     ASSERT_TRUE(cbFunc);
+    ASSERT_TRUE(cbPriority >= CB_PRIORITY_DEFAULT && cbPriority < CB_PRIORITY_LEVELS);
 
-    LK_LOCK(_hLock);
+    CB_WriteLock(cbSync);
+
+    // Make the definition visible to CB_SynchronizeAll()
+    CB_ListSync(cbSync);
 
     // Search for an empty registration within the callback array
     for (size_t idx = 0; idx<cbInfoLen; idx++)
@@ -154,15 +782,16 @@ BOOL _CB_AddCallback(CB_Info* cbInfo,
         if (cbInfo[idx].cbFunc == NULL)
         {
             // Save callback information into cbInfo array
-            cbInfo[idx].cbFunc = cbFunc;
-            cbInfo[idx].cbDispatchFunc = cbDispatchFunc;
-            cbInfo[idx].cbUserData = cbUserData;
+            // A conflating registration owns the state at the same index
+            CB_Conflate* cbEntry = cbConflate ? &cbConflate[idx] : NULL;
+            CB_WriteInfo(cbSync, &cbInfo[idx], cbFunc, cbDispatchFunc, cbTarget, cbUserData, cbPriority,
+                cbEntry, cbEntry ? CB_CONFLATE_GEN(AT_LOAD32(&cbEntry->cbState)) : 0, cbBatch);
             success = TRUE;
             break;
         }
     }
 
-    LK_UNLOCK(_hLock);
+    CB_WriteUnlock(cbSync);
 
     // Assert if all registration locations are full
     ASSERT_TRUE(success == TRUE);
@@ -172,80 +801,277 @@ BOOL _CB_AddCallback(CB_Info* cbInfo,
 //----------------------------------------------------------------------------
 // _CB_RemoveCallback
 //----------------------------------------------------------------------------
-BOOL _CB_RemoveCallback(CB_Info* cbInfo,
+BOOL _CB_RemoveCallback(CB_Sync* cbSync,
+    CB_Info* cbInfo,
     size_t cbInfoLen,
     CB_CallbackFuncType cbFunc,
-    CB_DispatchCallbackFuncType cbDispatchFunc)
+    CB_DispatchCallbackFuncType cbDispatchFunc,
+    const CB_DispatchTarget* cbTarget)
 {
     BOOL success = FALSE;
 
+    ASSERT_TRUE(cbSync);
     ASSERT_TRUE(cbInfo);
     ASSERT_TRUE(cbFunc);
     ASSERT_TRUE(cbInfoLen > 0);
 
-    LK_LOCK(_hLock);
+    CB_WriteLock(cbSync);
 
     // Search for the registered data within the callback array
     for (size_t idx = 0; idx<cbInfoLen; idx++)
     {
         // Does caller's callback match?
         if (cbInfo[idx].cbFunc == cbFunc &&
-            cbInfo[idx].cbDispatchFunc == cbDispatchFunc)
+            cbInfo[idx].cbDispatchFunc == cbDispatchFunc &&
+            cbInfo[idx].cbTarget == cbTarget)
         {
+            // Discard undelivered conflated data. A later registration in 
+            // this slot never receives it.
+            if (cbInfo[idx].cbConflate)
+                CB_WithdrawConflate(cbInfo[idx].cbConflate);
+
             // Remove callback function pointer from cbInfo array
-            cbInfo[idx].cbFunc = NULL;
-            cbInfo[idx].cbDispatchFunc = NULL;
-            cbInfo[idx].cbUserData = NULL;
+            CB_WriteInfo(cbSync, &cbInfo[idx], NULL, NULL, NULL, NULL, CB_PRIORITY_DEFAULT, NULL, 0, FALSE);
             success = TRUE;
             break;
         }
     }
 
-    LK_UNLOCK(_hLock);
+    CB_WriteUnlock(cbSync);
     return success;
 } 
 
 //----------------------------------------------------------------------------
 // _CB_IsAdded
 //----------------------------------------------------------------------------
-BOOL _CB_IsAdded(CB_Info* cbInfo,
+BOOL _CB_IsAdded(CB_Sync* cbSync,
+    const CB_Info* cbInfo,
     size_t cbInfoLen,
     CB_CallbackFuncType cbFunc,
-    CB_DispatchCallbackFuncType cbDispatchFunc)
+    CB_DispatchCallbackFuncType cbDispatchFunc,
+    const CB_DispatchTarget* cbTarget)
 {
     BOOL isAdded = FALSE;
+    INT32 seq;
 
+    ASSERT_TRUE(cbSync);
     ASSERT_TRUE(cbInfo);
     ASSERT_TRUE(cbInfoLen > 0);
     ASSERT_TRUE(cbFunc);
 
-    LK_LOCK(_hLock);
+    do
+    {
+        seq = CB_ReadBegin(cbSync);
+        isAdded = FALSE;
+
+        // Search for the registered data within the callback array
+        for (size_t idx = 0; idx<cbInfoLen; idx++)
+        {
+            // Does the caller's callback match?
+            if (AT_LOAD_PTR(&cbInfo[idx].cbFunc) == cbFunc &&
+                AT_LOAD_PTR(&cbInfo[idx].cbDispatchFunc) == cbDispatchFunc &&
+                AT_LOAD_PTR(&cbInfo[idx].cbTarget) == cbTarget)
+            {
+                isAdded = TRUE;
+                break;
+            }
+        }
+    } while (AT_LOAD32(&cbSync->seq) != seq);
 
-    // Search for the registered data within the callback array
+    return isAdded;
+}
+
+//----------------------------------------------------------------------------
+// _CB_ReadLock
+//----------------------------------------------------------------------------
+INT32 _CB_ReadLock(CB_Sync* cbSync)
+{
+    // Count this invoke on the current epoch. The registrations are read 
+    // only after the count is visible to CB_Synchronize().
+    INT32 cbEpoch = AT_LOAD32(&cbSync->epoch) & 1;
+    AT_ADD32(&cbSync->readers[cbEpoch], 1);
+    return cbEpoch;
+}
+
+//----------------------------------------------------------------------------
+// _CB_ReadUnlock
+//----------------------------------------------------------------------------
+void _CB_ReadUnlock(CB_Sync* cbSync, INT32 cbEpoch)
+{
+    AT_ADD32(&cbSync->readers[cbEpoch], -1);
+}
+
+//----------------------------------------------------------------------------
+// _CB_Synchronize
+//----------------------------------------------------------------------------
+void _CB_Synchronize(CB_Sync* cbSync)
+{
+    INT32 cbEpoch;
+    int pass;
+
+    ASSERT_TRUE(cbSync);
+
+    // One grace period at a time per callback definition
+    while (!AT_CAS32(&cbSync->syncLock, 0, 1))
+        AT_YIELD();
+
+    // Flip the epoch so new invokes count on the other reader count, then wait
+    // for the previous epoch to drain. An invoke that read the epoch just 
+    // before a flip may count itself late on the old epoch, so flip twice to 
+    // wait out both counts.
+    for (pass = 0; pass < 2; pass++)
+    {
+        cbEpoch = AT_LOAD32(&cbSync->epoch) & 1;
+        AT_STORE32(&cbSync->epoch, cbEpoch ^ 1);
+
+        // Synchronous callbacks run within an invoke, so the wait may be long
+        while (AT_LOAD32(&cbSync->readers[cbEpoch]) != 0)
+            AT_YIELD();
+    }
+
+    AT_STORE32(&cbSync->syncLock, 0);
+}
+
+//----------------------------------------------------------------------------
+// CB_SynchronizeAll
+//----------------------------------------------------------------------------
+void CB_SynchronizeAll(void)
+{
+    CB_Sync* cbSync;
+
+    // A definition linked after the walk starts had no registration before
+    // this call
+    for (cbSync = (CB_Sync*)AT_LOAD_PTR(&cbSyncList); cbSync; cbSync = cbSync->next)
+        _CB_Synchronize(cbSync);
+}
+
+//----------------------------------------------------------------------------
+// _CB_Snapshot
+//----------------------------------------------------------------------------
+void _CB_Snapshot(CB_Sync* cbSync, const CB_Info* cbInfo, CB_Info* cbSnapshot, 
+    size_t cbInfoLen)
+{
+    INT32 seq;
+
+    ASSERT_TRUE(cbSync);
+    ASSERT_TRUE(cbInfo);
+    ASSERT_TRUE(cbSnapshot);
+
+    // Copy the registrations without locking. Retry if a registration 
+    // changed during the copy.
+    do
+    {
+        seq = CB_ReadBegin(cbSync);
+
+        for (size_t idx = 0; idx<cbInfoLen; idx++)
+        {
+            cbSnapshot[idx].cbFunc = AT_LOAD_PTR(&cbInfo[idx].cbFunc);
+            cbSnapshot[idx].cbDispatchFunc = AT_LOAD_PTR(&cbInfo[idx].cbDispatchFunc);
+            cbSnapshot[idx].cbTarget = AT_LOAD_PTR(&cbInfo[idx].cbTarget);
+            cbSnapshot[idx].cbUserData = AT_LOAD_PTR(&cbInfo[idx].cbUserData);
+            cbSnapshot[idx].cbPriority = AT_LOAD32(&cbInfo[idx].cbPriority);
+            cbSnapshot[idx].cbConflate = AT_LOAD_PTR(&cbInfo[idx].cbConflate);
+            cbSnapshot[idx].cbGeneration = AT_LOAD32(&cbInfo[idx].cbGeneration);
+            cbSnapshot[idx].cbBatch = AT_LOAD32(&cbInfo[idx].cbBatch);
+        }
+    } while (AT_LOAD32(&cbSync->seq) != seq);
+}
+
+//----------------------------------------------------------------------------
+// CB_DispatchAll
+//----------------------------------------------------------------------------
+static BOOL CB_DispatchAll(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData,
+    size_t cbDataSize, CB_SharedData* cbShared, const CB_InvokeParams* cbParams)
+{
+    BOOL invoked = FALSE;
+
+    // For each CB_Info instance within the array
     for (size_t idx = 0; idx<cbInfoLen; idx++)
     {
-        // Does the caller's callback match?
-        if (cbInfo[idx].cbFunc == cbFunc &&
-            cbInfo[idx].cbDispatchFunc == cbDispatchFunc)
+        // Is a client registered?
+        if (cbInfo[idx].cbFunc)
         {
-            isAdded = TRUE;
-            break;
+            // Dispatch callback onto the OS task
+            if (CB_DispatchCallback(&cbInfo[idx], cbData, cbDataSize, cbShared, cbParams))
+            {
+                invoked = TRUE;
+            }
         }
     }
 
-    LK_UNLOCK(_hLock);
-    return isAdded;
+    return invoked;
 }
 
 //----------------------------------------------------------------------------
 // _CB_Dispatch
 //----------------------------------------------------------------------------
 BOOL _CB_Dispatch(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData, 
-    size_t cbDataSize)
+    size_t cbDataSize, const CB_InvokeParams* cbParams)
+{
+    BOOL invoked = FALSE;
+    CB_SharedData* cbShared = NULL;
+
+    // Callback data too large to store inline is copied one time into a 
+    // shared block when multiple asynchronous subscribers are registered
+    if (cbDataSize > CB_INLINE_DATA_SIZE && CB_CountAsync(cbInfo, cbInfoLen) > 1)
+    {
+        cbShared = CB_AllocShared(cbData, cbDataSize);
+        if (!cbShared)
+        {
+            // Out of memory
+            ASSERT();
+        }
+    }
+
+    invoked = CB_DispatchAll(cbInfo, cbInfoLen, cbData, cbDataSize, cbShared, cbParams);
+
+    // Release the dispatching thread's shared data reference
+    if (cbShared)
+        CB_ReleaseShared(cbShared);
+
+    return invoked;
+}
+
+//----------------------------------------------------------------------------
+// _CB_DispatchNoCopy
+//----------------------------------------------------------------------------
+BOOL _CB_DispatchNoCopy(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData, 
+    CB_ReleaseFuncType cbReleaseFunc, void* cbReleaseUserData)
+{
+    BOOL invoked = FALSE;
+    CB_SharedData* cbShared = NULL;
+
+    // All subscribers reference the publisher's buffer
+    cbShared = CB_AllocBorrowed(cbData, cbReleaseFunc, cbReleaseUserData);
+    if (cbShared)
+    {
+        invoked = CB_DispatchAll(cbInfo, cbInfoLen, cbData, 0, cbShared, NULL);
+
+        // Release the dispatching thread's reference. If no asynchronous 
+        // subscriber holds a reference the buffer is released here.
+        CB_ReleaseShared(cbShared);
+    }
+    else
+    {
+        // Out of memory
+        ASSERT();
+    }
+
+    return invoked;
+}
+
+//----------------------------------------------------------------------------
+// _CB_DispatchBatch
+//----------------------------------------------------------------------------
+BOOL _CB_DispatchBatch(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData, 
+    size_t cbDataSize, size_t cbCount)
 {
     BOOL invoked = FALSE;
 
-    LK_LOCK(_hLock);
+    if (cbCount == 0)
+        return FALSE;
+
+    ASSERT_TRUE(cbData);
 
     // For each CB_Info instance within the array
     for (size_t idx = 0; idx<cbInfoLen; idx++)
@@ -253,15 +1079,13 @@ BOOL _CB_Dispatch(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData,
         // Is a client registered?
         if (cbInfo[idx].cbFunc)
         {
-            // Dispatch callback onto the OS task
-            if (CB_DispatchCallback(&cbInfo[idx], cbData, cbDataSize))
+            // Dispatch every element onto the OS task at once
+            if (CB_DispatchBatchCallback(&cbInfo[idx], cbData, cbDataSize, cbCount))
             {
                 invoked = TRUE;
             }
         }
     }
 
-    LK_UNLOCK(_hLock);
     return invoked;
 }
-
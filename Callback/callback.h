@@ -15,9 +15,19 @@
 // Each target OS task must implement a single function conforming to 
 // CB_DispatchCallbackFuncType. The function implementation must post the pointer
 // to CB_CallbackMsg into a message queue and call CB_TargetInvoke() on the 
-// destination task. All dynamic storage allocation and deallocation is handled 
-// automatically by the callback module. Abstracting the OS task and queue 
-// implementation details makes the callback module generic to any application. 
+// destination task. Targets created at runtime instead supply a 
+// CB_DispatchTarget whose function also receives a context pointer, and 
+// subscribers register with CB_RegisterTarget(). The cbNext and cbMsgId 
+// fields are owned by the dispatch implementation and allow an intrusive 
+// queue with no per-message allocation. All dynamic storage allocation and 
+// deallocation is handled automatically by the callback module. Abstracting 
+// the OS task and queue implementation details makes the callback module 
+// generic to any application. 
+//
+// A dispatch function always receives one message per call unless the 
+// subscriber registers with CB_RegisterBatch(). CB_InvokeBatch() then passes a
+// chain of messages linked through cbNext in one dispatch call. The dispatch 
+// function must enqueue the whole chain, or none of it and return FALSE.
 //
 // Publisher example:
 //
@@ -31,6 +41,19 @@
 // int data = 123;
 // CB_Invoke(TestCb, &data);
 //
+// // Publisher passes optional invoke parameters such as an ordering key
+// CB_InvokeParams params = { 42 };
+// CB_InvokeEx(TestCb, &data, &params);
+//
+// // Publisher passes a buffer it owns without copying. BufferReleased() is 
+// // called after the last subscriber is finished with the buffer.
+// CB_InvokeNoCopy(TestCb, &data, BufferReleased, NULL);
+//
+// // Publisher invokes each callback once per array element. A batch 
+// // registration receives all elements with one dispatch.
+// int samples[64];
+// CB_InvokeBatch(TestCb, samples, 64);
+//
 // Subscriber example:
 // 
 // // Callback function
@@ -45,16 +68,47 @@
 // // Register to receive asychronous callbacks on thread 1
 // CB_Register(TestCb, TestCallback, DispatchCallbackThread1, NULL);
 //
+// // Register to receive asynchronous callbacks on a runtime created target
+// CB_RegisterTarget(TestCb, TestCallback, target, NULL);
+//
+// // Register to receive asynchronous callbacks ahead of default priority 
+// // messages queued on thread 1
+// CB_RegisterPriority(TestCb, TestCallback, DispatchCallbackThread1, NULL, 
+//     CB_PRIORITY_URGENT);
+//
+// // Register to receive only the newest data on thread 1. Invokes made while
+// // a callback is pending replace its data instead of queuing another message.
+// // Requires CB_DEFINE_CONFLATE in place of CB_DEFINE. Unregistering 
+// // discards undelivered data.
+// CB_RegisterConflate(TestCb, TestCallback, DispatchCallbackThread1, NULL);
+//
+// // Register to receive CB_InvokeBatch() elements on thread 1 as one chain of
+// // messages. DispatchCallbackThread1 must accept a chain.
+// CB_RegisterBatch(TestCb, TestCallback, DispatchCallbackThread1, NULL);
+//
 // // Unregister from publisher callbacks
 // CB_Unregister(TestCb, TestCallback, NULL);
 // CB_Unregister(TestCb, TestCallback, DispatchCallbackThread1);
+//
+// CB_Invoke() never locks. Each invoke dispatches to a snapshot of the 
+// registrations taken at the start of the call, so a concurrent invoke may
+// still call a callback once after CB_Unregister() returns. Call 
+// CB_Synchronize() after unregistering to wait for those invokes to finish 
+// before freeing the subscriber's state or dispatch target. e.g.
+//
+// CB_Unregister(TestCb, TestCallback, DispatchCallbackThread1);
+// CB_Synchronize(TestCb);
+//
+// CB_Synchronize() does not wait for messages already queued on a target. 
+// Never call it from a synchronous callback; it would wait for itself.
 
 #ifndef _CALLBACK_H
 #define _CALLBACK_H
 
-#include "callback_allocator.h"
 #include "callback_allocator.h"
 #include "DataTypes.h"
+#include <stddef.h>
+#include "AtomicOps.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,7 +117,24 @@ extern "C" {
 // Callback function pointer type
 typedef void (*CB_CallbackFuncType)(const void* cbData, void* cbUserData);
 
-typedef struct 
+// Release function called when all subscribers are finished with callback data
+// passed to CB_InvokeNoCopy(). cbData is the publisher's original buffer.
+typedef void (*CB_ReleaseFuncType)(const void* cbData, void* cbReleaseUserData);
+
+// Callback message priorities. A dispatch implementation with priority lanes
+// runs higher priority messages first. Implementations may ignore priority.
+#define CB_PRIORITY_DEFAULT     0
+#define CB_PRIORITY_HIGH        1
+#define CB_PRIORITY_URGENT      2
+#define CB_PRIORITY_LEVELS      3
+
+// Callback data up to CB_INLINE_DATA_SIZE bytes is copied inline within a fixed
+// size CB_CallbackMsg. Larger data uses a variable size callback allocator block.
+#ifndef CB_INLINE_DATA_SIZE
+#define CB_INLINE_DATA_SIZE     16
+#endif
+
+typedef struct CB_CallbackMsg
 {
     // A pointer to the registered callback function
     CB_CallbackFuncType cbFunc;
@@ -73,11 +144,88 @@ typedef struct
 
     // Optional user data passed back on each callback
     void* cbUserData;
+
+    // Reserved for the target OS task dispatch implementation. The queue link 
+    // and message identifier let a dispatch function enqueue the message 
+    // without allocating a separate queue node. The timestamp lets it measure
+    // dispatch latency.
+    struct CB_CallbackMsg* cbNext;
+    INT64 cbTimestamp;
+    INT cbMsgId;
+
+    // Invoke parameters for the dispatch implementation. See CB_InvokeParams.
+    // The priority is the higher of the registration and invoke priorities.
+    UINT32 cbKey;
+    UINT16 cbPriority;
+
+    // Message storage flags. Private to the callback module.
+    UINT16 cbFlags;
+
+    // Callback data storage. Must be the last member. Data larger than 
+    // CB_INLINE_DATA_SIZE extends past the end of the structure. A message 
+    // referencing callback data shared among subscribers stores the shared 
+    // block pointer instead.
+    union
+    {
+        char data[CB_INLINE_DATA_SIZE];
+        double align;
+        struct CB_SharedData* shared;
+        INT32 generation;
+    } cbInline;
 } CB_CallbackMsg;
 
-// Each OS task dispatch function must conform to this signature 
+// Size of the CB_CallbackMsg header. Callback data is bitwise copied into the
+// cbInline storage. Larger data continues past the header within the same 
+// allocator block.
+#define CB_MSG_HEADER_SIZE      offsetof(CB_CallbackMsg, cbInline)
+
+// Per registration state of a conflating subscriber. Private to the callback 
+// module. At most one trigger message per subscriber is queued at a time. The
+// newest callback data waits in cbLatest and replaces any undelivered data.
+typedef struct CB_Conflate
+{
+    // Newest undelivered data message or NULL
+    CB_CallbackMsg* volatile cbLatest;
+
+    // Registration generation shifted left by one. The low bit is set while a
+    // trigger is queued. Unregistering advances the generation so a trigger 
+    // still queued on the old target does nothing.
+    ATOMIC_INT32 cbState;
+} CB_Conflate;
+
+// Optional parameters passed to CB_InvokeEx() and copied into each 
+// CB_CallbackMsg for the dispatch implementation
+typedef struct
+{
+    // Ordering key. e.g. a sharded dispatch target keeps messages with equal
+    // keys in order on one OS task.
+    UINT32 cbKey;
+
+    // Message priority, CB_PRIORITY_DEFAULT to CB_PRIORITY_URGENT
+    UINT16 cbPriority;
+} CB_InvokeParams;
+
+// Each OS task dispatch function must conform to this signature. Return FALSE
+// if cbMsg could not be queued; the callback module then frees cbMsg. For a 
+// CB_RegisterBatch() registration cbMsg may be the head of a chain linked 
+// through cbNext; queue every message.
 typedef BOOL (*CB_DispatchCallbackFuncType)(const CB_CallbackMsg* cbMsg);
 
+// A dispatch function that also receives the target's context pointer. Same 
+// rules as CB_DispatchCallbackFuncType.
+typedef BOOL (*CB_DispatchTargetFuncType)(const CB_CallbackMsg* cbMsg, void* cbContext);
+
+// A dispatch target created at runtime, e.g. one of many worker threads. The
+// target must remain valid while registered and while messages are queued.
+typedef struct
+{
+    // A pointer to a dispatch function that places CB_CallbackMsg into a message queue
+    CB_DispatchTargetFuncType cbDispatchFunc;
+
+    // Passed to cbDispatchFunc on each dispatch, e.g. the OS task instance
+    void* cbContext;
+} CB_DispatchTarget;
+
 typedef struct
 {
     // A pointer to the registered callback function
@@ -86,27 +234,94 @@ typedef struct
     // A pointer to a dispatch function that places CB_CallbackMsg into a message queue
     CB_DispatchCallbackFuncType cbDispatchFunc;
 
+    // A context carrying dispatch target. Used instead of cbDispatchFunc if not NULL.
+    const CB_DispatchTarget* cbTarget;
+
     // Optional user data passed back on each callback
     void* cbUserData;
+
+    // Priority of every message dispatched to this registration
+    ATOMIC_INT32 cbPriority;
+
+    // Conflating registration state or NULL to queue every invoke
+    CB_Conflate* cbConflate;
+
+    // Generation of cbConflate owned by this registration
+    ATOMIC_INT32 cbGeneration;
+
+    // TRUE if the dispatch function accepts a CB_InvokeBatch() message chain
+    ATOMIC_INT32 cbBatch;
 } CB_Info;
 
+// Per callback definition synchronization state. Private to the callback module.
+// Each CB_DEFINE owns one instance so unrelated callbacks never contend.
+typedef struct CB_Sync
+{
+    // Sequence lock protecting the CB_Info array. Odd while a registration 
+    // change is in progress. Invoke copies the array without locking and 
+    // retries if the sequence changed during the copy.
+    ATOMIC_INT32 seq;
+
+    // Serializes register and unregister on this callback definition
+    ATOMIC_INT32 lock;
+
+    // Grace period state. Each invoke counts itself on the current epoch's 
+    // reader count until its dispatch completes. CB_Synchronize() flips the
+    // epoch and waits for the previous epoch's readers to drain.
+    ATOMIC_INT32 readers[2];
+    ATOMIC_INT32 epoch;
+
+    // Serializes CB_Synchronize() callers
+    ATOMIC_INT32 syncLock;
+
+    // Next definition walked by CB_SynchronizeAll(). Linked on first register.
+    struct CB_Sync* next;
+    ATOMIC_INT32 listed;
+} CB_Sync;
+
 // User macros to ease using the callback wrapper functions.
 // cbName - the callback name as set within CB_DECLARE
 // cbFunc - a callback function matching the callback signature
 // cbDispatchFunc - the destination task dispatch function for an asynchronous 
 //      callback or NULL for a synchronous callback
+// cbTarget - the destination CB_DispatchTarget for an asynchronous callback
 // cbArg - the callback function argument (must be a pointer type)
 // cbNum - number of cbData elements pointed to by cbData
 // cbSize - the size of each cbData element
+// cbReleaseFunc - called after the last subscriber is finished with cbArg
+// cbReleaseUserData - optional data passed to cbReleaseFunc
+// cbCount - number of cbArg elements, each invoked as a separate callback
+// cbParams - optional CB_InvokeParams pointer or NULL
+// cbPriority - message priority, CB_PRIORITY_DEFAULT to CB_PRIORITY_URGENT
 // cbUserData - optional data passed back during each callback. Can point to 
 //      anything the subscriber wants. Set to NULL if not using user data. 
 // e.g. CB_Register(MyCallback, TestCallbackFunc, DispatchFunc);
 #define CB_Register(cbName, cbFunc, cbDispatchFunc, cbUserData)  cbName##_Register(cbFunc, cbDispatchFunc, cbUserData)
 #define CB_Unregister(cbName, cbFunc, cbDispatchFunc)            cbName##_Unregister(cbFunc, cbDispatchFunc)
+#define CB_RegisterTarget(cbName, cbFunc, cbTarget, cbUserData)  cbName##_RegisterTarget(cbFunc, cbTarget, cbUserData)
+#define CB_RegisterPriority(cbName, cbFunc, cbDispatchFunc, cbUserData, cbPriority) \
+    cbName##_RegisterPriority(cbFunc, cbDispatchFunc, NULL, cbUserData, cbPriority)
+#define CB_RegisterTargetPriority(cbName, cbFunc, cbTarget, cbUserData, cbPriority) \
+    cbName##_RegisterPriority(cbFunc, NULL, cbTarget, cbUserData, cbPriority)
+#define CB_RegisterConflate(cbName, cbFunc, cbDispatchFunc, cbUserData) \
+    cbName##_RegisterConflate(cbFunc, cbDispatchFunc, NULL, cbUserData)
+#define CB_RegisterTargetConflate(cbName, cbFunc, cbTarget, cbUserData) \
+    cbName##_RegisterConflate(cbFunc, NULL, cbTarget, cbUserData)
+#define CB_RegisterBatch(cbName, cbFunc, cbDispatchFunc, cbUserData) \
+    cbName##_RegisterBatch(cbFunc, cbDispatchFunc, NULL, cbUserData)
+#define CB_RegisterTargetBatch(cbName, cbFunc, cbTarget, cbUserData) \
+    cbName##_RegisterBatch(cbFunc, NULL, cbTarget, cbUserData)
+#define CB_UnregisterTarget(cbName, cbFunc, cbTarget)            cbName##_UnregisterTarget(cbFunc, cbTarget)
 #define CB_Invoke(cbName, cbArg)                                 cbName##_Invoke(cbArg)
+#define CB_InvokeEx(cbName, cbArg, cbParams)                     cbName##_InvokeEx(cbArg, cbParams)
 #define CB_InvokeArray(cbName, cbArg, cbNum, cbSize)             cbName##_InvokeArray(cbArg, cbNum, cbSize)
+#define CB_InvokeNoCopy(cbName, cbArg, cbReleaseFunc, cbReleaseUserData) \
+    cbName##_InvokeNoCopy(cbArg, cbReleaseFunc, cbReleaseUserData)
+#define CB_InvokeBatch(cbName, cbArg, cbCount)                   cbName##_InvokeBatch(cbArg, cbCount)
 #define CB_IsRegistered(cbName, cbFunc, cbDispatchFunc)          cbName##_IsRegistered(cbFunc, cbDispatchFunc)
+#define CB_IsTargetRegistered(cbName, cbFunc, cbTarget)          cbName##_IsTargetRegistered(cbFunc, cbTarget)
 #define CB_GetCbInfo(cbName, cbIdx)                              cbName##_GetCbInfo(cbIdx)
+#define CB_Synchronize(cbName)                                   cbName##_Synchronize()
 
 // Declare type-safe callback wrapper functions.
 // cbName - name your callback with any unique name
@@ -117,9 +332,22 @@ typedef struct
     BOOL cbName##_Register(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, void* cbUserData); \
     BOOL cbName##_IsRegistered(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc); \
     BOOL cbName##_Unregister(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc); \
+    BOOL cbName##_RegisterTarget(cbName##CallbackFuncType cbFunc, const CB_DispatchTarget* cbTarget, void* cbUserData); \
+    BOOL cbName##_RegisterPriority(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, \
+        const CB_DispatchTarget* cbTarget, void* cbUserData, INT32 cbPriority); \
+    BOOL cbName##_RegisterConflate(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, \
+        const CB_DispatchTarget* cbTarget, void* cbUserData); \
+    BOOL cbName##_RegisterBatch(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, \
+        const CB_DispatchTarget* cbTarget, void* cbUserData); \
+    BOOL cbName##_IsTargetRegistered(cbName##CallbackFuncType cbFunc, const CB_DispatchTarget* cbTarget); \
+    BOOL cbName##_UnregisterTarget(cbName##CallbackFuncType cbFunc, const CB_DispatchTarget* cbTarget); \
     BOOL cbName##_Invoke(cbArg cbData); \
+    BOOL cbName##_InvokeEx(cbArg cbData, const CB_InvokeParams* cbParams); \
     BOOL cbName##_InvokeArray(cbArg cbData, size_t num, size_t size); \
-    const CB_Info* cbName##_GetCbInfo(unsigned int cbIdx);
+    BOOL cbName##_InvokeNoCopy(cbArg cbData, CB_ReleaseFuncType cbReleaseFunc, void* cbReleaseUserData); \
+    BOOL cbName##_InvokeBatch(cbArg cbData, size_t count); \
+    const CB_Info* cbName##_GetCbInfo(unsigned int cbIdx); \
+    void cbName##_Synchronize(void);
 
 // Define type-safe callback wrapper functions.
 // cbName - name your callback with any unique name
@@ -129,43 +357,135 @@ typedef struct
 // e.g. CB_DEFINE(MyCallback, int*, sizeof(int), 2)
 #define CB_DEFINE(cbName, cbArg, cbArgSize, cbMax) \
     static CB_Info cbName##Multicast[cbMax]; \
+    static CB_Sync cbName##Sync; \
     BOOL cbName##_Register(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, void* cbUserData) { \
-        return _CB_AddCallback(&cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc, cbUserData); \
+        return _CB_AddCallback(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc, NULL, cbUserData, CB_PRIORITY_DEFAULT, NULL, FALSE); \
     } \
     BOOL cbName##_IsRegistered(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc) { \
-        return _CB_IsAdded(&cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc); \
+        return _CB_IsAdded(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc, NULL); \
     } \
     BOOL cbName##_Unregister(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc) { \
-        return _CB_RemoveCallback(&cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc); \
+        return _CB_RemoveCallback(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc, NULL); \
+    } \
+    BOOL cbName##_RegisterTarget(cbName##CallbackFuncType cbFunc, const CB_DispatchTarget* cbTarget, void* cbUserData) { \
+        return _CB_AddCallback(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, NULL, cbTarget, cbUserData, CB_PRIORITY_DEFAULT, NULL, FALSE); \
+    } \
+    BOOL cbName##_RegisterPriority(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, \
+        const CB_DispatchTarget* cbTarget, void* cbUserData, INT32 cbPriority) { \
+        return _CB_AddCallback(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc, cbTarget, cbUserData, cbPriority, NULL, FALSE); \
+    } \
+    BOOL cbName##_RegisterBatch(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, \
+        const CB_DispatchTarget* cbTarget, void* cbUserData) { \
+        return _CB_AddCallback(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc, cbTarget, cbUserData, CB_PRIORITY_DEFAULT, NULL, TRUE); \
+    } \
+    BOOL cbName##_IsTargetRegistered(cbName##CallbackFuncType cbFunc, const CB_DispatchTarget* cbTarget) { \
+        return _CB_IsAdded(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, NULL, cbTarget); \
+    } \
+    BOOL cbName##_UnregisterTarget(cbName##CallbackFuncType cbFunc, const CB_DispatchTarget* cbTarget) { \
+        return _CB_RemoveCallback(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, NULL, cbTarget); \
     } \
     BOOL cbName##_Invoke(cbArg cbData) { \
-        return _CB_Dispatch(&cbName##Multicast[0], cbMax, cbData, cbArgSize); \
+        CB_Info cbSnapshot[cbMax]; \
+        INT32 cbEpoch = _CB_ReadLock(&cbName##Sync); \
+        BOOL cbInvoked; \
+        _CB_Snapshot(&cbName##Sync, &cbName##Multicast[0], cbSnapshot, cbMax); \
+        cbInvoked = _CB_Dispatch(cbSnapshot, cbMax, cbData, cbArgSize, NULL); \
+        _CB_ReadUnlock(&cbName##Sync, cbEpoch); \
+        return cbInvoked; \
+    } \
+    BOOL cbName##_InvokeEx(cbArg cbData, const CB_InvokeParams* cbParams) { \
+        CB_Info cbSnapshot[cbMax]; \
+        INT32 cbEpoch = _CB_ReadLock(&cbName##Sync); \
+        BOOL cbInvoked; \
+        _CB_Snapshot(&cbName##Sync, &cbName##Multicast[0], cbSnapshot, cbMax); \
+        cbInvoked = _CB_Dispatch(cbSnapshot, cbMax, cbData, cbArgSize, cbParams); \
+        _CB_ReadUnlock(&cbName##Sync, cbEpoch); \
+        return cbInvoked; \
     } \
     BOOL cbName##_InvokeArray(cbArg cbData, size_t num, size_t size) { \
-        return _CB_Dispatch(&cbName##Multicast[0], cbMax, cbData, num * size); \
+        CB_Info cbSnapshot[cbMax]; \
+        INT32 cbEpoch = _CB_ReadLock(&cbName##Sync); \
+        BOOL cbInvoked; \
+        _CB_Snapshot(&cbName##Sync, &cbName##Multicast[0], cbSnapshot, cbMax); \
+        cbInvoked = _CB_Dispatch(cbSnapshot, cbMax, cbData, num * size, NULL); \
+        _CB_ReadUnlock(&cbName##Sync, cbEpoch); \
+        return cbInvoked; \
+    } \
+    BOOL cbName##_InvokeNoCopy(cbArg cbData, CB_ReleaseFuncType cbReleaseFunc, void* cbReleaseUserData) { \
+        CB_Info cbSnapshot[cbMax]; \
+        INT32 cbEpoch = _CB_ReadLock(&cbName##Sync); \
+        BOOL cbInvoked; \
+        _CB_Snapshot(&cbName##Sync, &cbName##Multicast[0], cbSnapshot, cbMax); \
+        cbInvoked = _CB_DispatchNoCopy(cbSnapshot, cbMax, cbData, cbReleaseFunc, cbReleaseUserData); \
+        _CB_ReadUnlock(&cbName##Sync, cbEpoch); \
+        return cbInvoked; \
+    } \
+    BOOL cbName##_InvokeBatch(cbArg cbData, size_t count) { \
+        CB_Info cbSnapshot[cbMax]; \
+        INT32 cbEpoch = _CB_ReadLock(&cbName##Sync); \
+        BOOL cbInvoked; \
+        _CB_Snapshot(&cbName##Sync, &cbName##Multicast[0], cbSnapshot, cbMax); \
+        cbInvoked = _CB_DispatchBatch(cbSnapshot, cbMax, cbData, cbArgSize, count); \
+        _CB_ReadUnlock(&cbName##Sync, cbEpoch); \
+        return cbInvoked; \
     } \
     const CB_Info* cbName##_GetCbInfo(unsigned int cbIdx) { \
         if (cbIdx >= cbMax) return NULL; \
         return &cbName##Multicast[cbIdx]; \
+    } \
+    void cbName##_Synchronize(void) { \
+        _CB_Synchronize(&cbName##Sync); \
     } 
 
+// Define type-safe callback wrapper functions that also accept conflating 
+// registrations with CB_RegisterConflate(). Same arguments as CB_DEFINE. 
+// Reserves a CB_Conflate per registration slot, so use only for callbacks 
+// that need conflation.
+// e.g. CB_DEFINE_CONFLATE(MyCallback, int*, sizeof(int), 2)
+#define CB_DEFINE_CONFLATE(cbName, cbArg, cbArgSize, cbMax) \
+    CB_DEFINE(cbName, cbArg, cbArgSize, cbMax) \
+    static CB_Conflate cbName##Conflate[cbMax]; \
+    BOOL cbName##_RegisterConflate(cbName##CallbackFuncType cbFunc, CB_DispatchCallbackFuncType cbDispatchFunc, \
+        const CB_DispatchTarget* cbTarget, void* cbUserData) { \
+        return _CB_AddCallback(&cbName##Sync, &cbName##Multicast[0], cbMax, (CB_CallbackFuncType)cbFunc, cbDispatchFunc, cbTarget, cbUserData, CB_PRIORITY_DEFAULT, &cbName##Conflate[0], FALSE); \
+    }
+
 // Initialization function called one time at startup
 void CB_Init(void);
 
 // Terminate function called one time at shutdown
 void CB_Term(void);
 
+// Wait for invokes in progress on every callback definition to finish. Used
+// before deleting a dispatch target that may still be in a snapshot. Never
+// call from a synchronous callback.
+void CB_SynchronizeAll(void);
+
 // Called by a target OS task to invoke the callback function
 void CB_TargetInvoke(const CB_CallbackMsg* cbMsg);
 
+// Called by a target OS task to free a queued message without invoking the 
+// callback, e.g. a message dropped from a full queue or discarded at exit
+void CB_TargetDiscard(const CB_CallbackMsg* cbMsg);
+
 // Private functions. Do not call these functions directly.
-BOOL _CB_AddCallback(CB_Info* cbInfo, size_t cbInfoLen, CB_CallbackFuncType cbFunc,
-    CB_DispatchCallbackFuncType cbDispatchFunc, void* cbUserData);
-BOOL _CB_IsAdded(CB_Info* cbInfo, size_t cbInfoLen, CB_CallbackFuncType cbFunc,
-    CB_DispatchCallbackFuncType cbDispatchFunc);
-BOOL _CB_RemoveCallback(CB_Info* cbInfo, size_t cbInfoLen, CB_CallbackFuncType cbFunc,
-    CB_DispatchCallbackFuncType cbDispatchFunc);
-BOOL _CB_Dispatch(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData, size_t cbDataSize);
+BOOL _CB_AddCallback(CB_Sync* cbSync, CB_Info* cbInfo, size_t cbInfoLen, CB_CallbackFuncType cbFunc,
+    CB_DispatchCallbackFuncType cbDispatchFunc, const CB_DispatchTarget* cbTarget, void* cbUserData,
+    INT32 cbPriority, CB_Conflate* cbConflate, BOOL cbBatch);
+BOOL _CB_IsAdded(CB_Sync* cbSync, const CB_Info* cbInfo, size_t cbInfoLen, CB_CallbackFuncType cbFunc,
+    CB_DispatchCallbackFuncType cbDispatchFunc, const CB_DispatchTarget* cbTarget);
+BOOL _CB_RemoveCallback(CB_Sync* cbSync, CB_Info* cbInfo, size_t cbInfoLen, CB_CallbackFuncType cbFunc,
+    CB_DispatchCallbackFuncType cbDispatchFunc, const CB_DispatchTarget* cbTarget);
+void _CB_Snapshot(CB_Sync* cbSync, const CB_Info* cbInfo, CB_Info* cbSnapshot, size_t cbInfoLen);
+INT32 _CB_ReadLock(CB_Sync* cbSync);
+void _CB_ReadUnlock(CB_Sync* cbSync, INT32 cbEpoch);
+void _CB_Synchronize(CB_Sync* cbSync);
+BOOL _CB_Dispatch(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData, size_t cbDataSize,
+    const CB_InvokeParams* cbParams);
+BOOL _CB_DispatchNoCopy(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData,
+    CB_ReleaseFuncType cbReleaseFunc, void* cbReleaseUserData);
+BOOL _CB_DispatchBatch(const CB_Info* cbInfo, size_t cbInfoLen, const void* cbData,
+    size_t cbDataSize, size_t cbCount);
 
 #ifdef __cplusplus
 }
@@ -1,32 +1,174 @@
 #include "callback_allocator.h"
+#include "callback.h"
 #include "x_allocator.h"
+#include "Fault.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define MAX_32_BLOCKS   20
+// Define USE_ALLOC_MAGAZINES to cache callback blocks within per-thread 
+// magazines. Each thread may hold up to ALLOC_MAGAZINE_SIZE blocks of each 
+// size class, so increase the block counts below accordingly.
+//#define USE_ALLOC_MAGAZINES
+
+// Fixed size CB_CallbackMsg blocks with inline callback data
+#define MAX_MSG_BLOCKS  20
+
+// Each block holds a CB_CallbackMsg header followed by callback data too large
+// to store inline. The size classes carry up to 64 and 128 bytes of data.
+#define MAX_64_BLOCKS   20
 #define MAX_128_BLOCKS  10
 
-#define BLOCK_32_SIZE     32 + XALLOC_BLOCK_META_DATA_SIZE
-#define BLOCK_128_SIZE    128 + XALLOC_BLOCK_META_DATA_SIZE
+#define BLOCK_64_SIZE     (CB_MSG_HEADER_SIZE + 64 + XALLOC_BLOCK_META_DATA_SIZE)
+#define BLOCK_128_SIZE    (CB_MSG_HEADER_SIZE + 128 + XALLOC_BLOCK_META_DATA_SIZE)
+
+// A burst beyond the static blocks grows each pool by heap slabs of 
+// SLAB_BLOCKS blocks, up to MAX_SLABS slabs. Set MAX_SLABS to 0 for fixed 
+// size pools.
+#define SLAB_BLOCKS     32
+#define MAX_SLABS       8
 
 // Define individual fb_allocators
-ALLOC_DEFINE(cbDataAllocator32, BLOCK_32_SIZE, MAX_32_BLOCKS)
-ALLOC_DEFINE(cbDataAllocator128, BLOCK_128_SIZE, MAX_128_BLOCKS)
+ALLOC_DEFINE_GROWABLE(cbMsgAllocator, sizeof(CB_CallbackMsg), MAX_MSG_BLOCKS, SLAB_BLOCKS, MAX_SLABS)
+ALLOC_DEFINE_GROWABLE(cbDataAllocator64, BLOCK_64_SIZE, MAX_64_BLOCKS, SLAB_BLOCKS, MAX_SLABS)
+ALLOC_DEFINE_GROWABLE(cbDataAllocator128, BLOCK_128_SIZE, MAX_128_BLOCKS, SLAB_BLOCKS, MAX_SLABS)
 
 // An array of allocators sorted by smallest block first
 static ALLOC_Allocator* allocators[] = {
-    &cbDataAllocator32Obj,
+    &cbDataAllocator64Obj,
     &cbDataAllocator128Obj
 };
 
 #define MAX_ALLOCATORS   (sizeof(allocators) / sizeof(allocators[0]))
 
-static XAllocData self = { allocators, MAX_ALLOCATORS };
+static XAllocData defaultData = { allocators, MAX_ALLOCATORS, { 0 }, 0 };
+
+// The compile time size classes unless CBALLOC_Configure() is called
+static XAllocData* self = &defaultData;
+
+// Set by CBALLOC_Init(). The size classes are fixed from then on.
+static BOOL initialized = FALSE;
+
+// Alignment of each configured block and region section
+#define CONFIG_ALIGN    ALLOC_MEM_ALIGN
+
+// Storage for each configured allocator name
+#define CONFIG_NAME_SIZE    32
+
+//----------------------------------------------------------------------------
+// CBALLOC_Init
+//----------------------------------------------------------------------------
+void CBALLOC_Init(void)
+{
+#ifdef USE_ALLOC_MAGAZINES
+    UINT16 i;
+#endif
+
+    initialized = TRUE;
+
+#ifdef USE_ALLOC_MAGAZINES
+    ALLOC_EnableMagazine(cbMsgAllocator);
+    for (i = 0; i < self->maxAllocators; i++)
+        ALLOC_EnableMagazine(self->allocators[i]);
+#endif
+}
+
+//----------------------------------------------------------------------------
+// CBALLOC_Configure
+//----------------------------------------------------------------------------
+BOOL CBALLOC_Configure(const CBALLOC_SizeClass* classes, UINT16 count)
+{
+    size_t offset, tableOffset, objOffset, nameOffset, poolOffset;
+    char* region;
+    char* name;
+    ALLOC_Allocator** pAllocators;
+    ALLOC_Allocator* pObjs;
+    ALLOC_Stats stats;
+    UINT16 i;
+
+    ASSERT_TRUE(classes);
+
+    // Only configure once and before CB_Init()
+    if (initialized || self != &defaultData || count == 0 || count >= 0xFF)
+        return FALSE;
+
+    // Blocks already taken from the compile time size classes would be freed
+    // into the configured ones
+    for (i = 0; i < defaultData.maxAllocators; i++)
+    {
+        ALLOC_GetStats(defaultData.allocators[i], &stats);
+        if (stats.blocksInUse != 0)
+        {
+            ASSERT();
+            return FALSE;
+        }
+    }
+
+    // Size classes must be sorted by smallest block first
+    for (i = 0; i < count; i++)
+    {
+        if (classes[i].size == 0 || classes[i].blocks == 0 ||
+            (i > 0 && classes[i].size <= classes[i - 1].size))
+            return FALSE;
+    }
+
+    // Lay out the XAllocData, allocator table, allocators, names and block 
+    // pools within one region
+    tableOffset = ALLOC_ROUND_UP(sizeof(XAllocData), CONFIG_ALIGN);
+    objOffset = tableOffset + ALLOC_ROUND_UP(count * sizeof(ALLOC_Allocator*), CONFIG_ALIGN);
+    nameOffset = objOffset + ALLOC_ROUND_UP(count * sizeof(ALLOC_Allocator), CONFIG_ALIGN);
+    poolOffset = nameOffset + ALLOC_ROUND_UP(count * CONFIG_NAME_SIZE, CONFIG_ALIGN);
+    offset = poolOffset;
+    for (i = 0; i < count; i++)
+    {
+        size_t blockSize = ALLOC_ROUND_UP(classes[i].size + XALLOC_BLOCK_META_DATA_SIZE, CONFIG_ALIGN);
+        offset += blockSize * classes[i].blocks;
+    }
+
+    region = (char*)calloc(1, offset);
+    if (!region)
+        return FALSE;
+
+    pAllocators = (ALLOC_Allocator**)(region + tableOffset);
+    pObjs = (ALLOC_Allocator*)(region + objOffset);
+    offset = poolOffset;
+    for (i = 0; i < count; i++)
+    {
+        size_t blockSize = ALLOC_ROUND_UP(classes[i].size + XALLOC_BLOCK_META_DATA_SIZE, CONFIG_ALIGN);
+
+        // Name each allocator by its size class so the statistics can be 
+        // told apart
+        name = region + nameOffset + (i * CONFIG_NAME_SIZE);
+        snprintf(name, CONFIG_NAME_SIZE, "cbConfigAllocator%lu", (unsigned long)classes[i].size);
+
+        // The allocator has const members. Initialize a local and copy it 
+        // into the region.
+        ALLOC_Allocator alloc = { name, region + offset, blockSize, 
+            blockSize, classes[i].blocks, SLAB_BLOCKS, MAX_SLABS, 
+            0, 0, 0, { 0 }, 0, 0, 0, 0, 0, 0 };
+
+        memcpy(&pObjs[i], &alloc, sizeof(alloc));
+        pAllocators[i] = &pObjs[i];
+
+        offset += blockSize * classes[i].blocks;
+    }
+
+    {
+        XAllocData data = { pAllocators, count, { 0 }, 0 };
+        memcpy(region, &data, sizeof(data));
+    }
+
+    // The region is retained for the life of the program
+    self = (XAllocData*)region;
+    return TRUE;
+}
 
 //----------------------------------------------------------------------------
 // CBALLOC_Alloc
 //----------------------------------------------------------------------------
 void* CBALLOC_Alloc(size_t size)
 {
-    return XALLOC_Alloc(&self, size);
+    return XALLOC_Alloc(self, size);
 }
 
 //----------------------------------------------------------------------------
@@ -42,7 +184,7 @@ void CBALLOC_Free(void* ptr)
 //----------------------------------------------------------------------------
 void* CBALLOC_Realloc(void *ptr, size_t new_size)
 {
-    return XALLOC_Realloc(&self, ptr, new_size);
+    return XALLOC_Realloc(self, ptr, new_size);
 }
 
 //----------------------------------------------------------------------------
@@ -50,6 +192,45 @@ void* CBALLOC_Realloc(void *ptr, size_t new_size)
 //----------------------------------------------------------------------------
 void* CBALLOC_Calloc(size_t num, size_t size)
 {
-    return XALLOC_Calloc(&self, num, size);
+    return XALLOC_Calloc(self, num, size);
+}
+
+
+//----------------------------------------------------------------------------
+// CBALLOC_AllocMsg
+//----------------------------------------------------------------------------
+void* CBALLOC_AllocMsg(void)
+{
+    return ALLOC_Alloc(cbMsgAllocator, sizeof(CB_CallbackMsg));
 }
 
+//----------------------------------------------------------------------------
+// CBALLOC_AllocMsgs
+//----------------------------------------------------------------------------
+UINT32 CBALLOC_AllocMsgs(void** msgs, UINT32 count)
+{
+    return ALLOC_AllocBulk(cbMsgAllocator, sizeof(CB_CallbackMsg), msgs, count);
+}
+
+//----------------------------------------------------------------------------
+// CBALLOC_FreeMsg
+//----------------------------------------------------------------------------
+void CBALLOC_FreeMsg(void* ptr)
+{
+    ALLOC_Free(cbMsgAllocator, ptr);
+}
+
+//----------------------------------------------------------------------------
+// CBALLOC_GetStats
+//----------------------------------------------------------------------------
+UINT16 CBALLOC_GetStats(ALLOC_Stats* stats, UINT16 maxStats)
+{
+    ASSERT_TRUE(stats || maxStats == 0);
+
+    if (maxStats == 0)
+        return 0;
+
+    // The inline message pool first followed by each data size class
+    ALLOC_GetStats(cbMsgAllocator, &stats[0]);
+    return 1 + XALLOC_GetStats(self, &stats[1], maxStats - 1);
+}
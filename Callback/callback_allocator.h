@@ -1,21 +1,65 @@
 // The callback_allocator module is a fixed block memory allocator that 
 // allocates/deallocates memory for callback data to travel through an 
-// OS task queue. 
+// OS task queue. Each pool starts with static blocks and grows by heap slabs
+// up to a fixed ceiling. 
+//
+// The default size classes are fixed at compile time. Optionally call 
+// CBALLOC_Configure() one time before CB_Init() to replace them with a table 
+// of size classes backed by one contiguous heap region. e.g.
+//
+// static const CBALLOC_SizeClass classes[] = {
+//     { 64, 32 }, { 256, 16 }, { 1024, 4 }
+// };
+// CBALLOC_Configure(classes, sizeof(classes) / sizeof(classes[0]));
+// CB_Init();
 
 #ifndef _CALLBACK_ALLOCATOR_H
 #define _CALLBACK_ALLOCATOR_H
 
 #include <stddef.h>
+#include "fb_allocator.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// A callback data size class
+typedef struct
+{
+    // Largest callback message, header plus data, in bytes
+    size_t size;
+
+    // Number of static blocks. The pool grows by heap slabs beyond this.
+    UINT32 blocks;
+} CBALLOC_SizeClass;
+
+// Replace the compile time size classes. Call one time before CB_Init(). 
+// classes - size classes sorted by smallest size first
+// count - number of classes
+// Return TRUE if configured. FALSE if the table is invalid, out of memory, 
+// already configured, or CBALLOC_Init() has run.
+BOOL CBALLOC_Configure(const CBALLOC_SizeClass* classes, UINT16 count);
+
+// Called one time at startup by CB_Init()
+void CBALLOC_Init(void);
+
 void* CBALLOC_Alloc(size_t size);
 void CBALLOC_Free(void* ptr);
 void* CBALLOC_Realloc(void *ptr, size_t new_size);
 void* CBALLOC_Calloc(size_t num, size_t size);
 
+// Fixed size CB_CallbackMsg blocks for callback data stored inline.
+// CBALLOC_AllocMsgs() allocates up to count blocks at once and returns the 
+// number allocated.
+void* CBALLOC_AllocMsg(void);
+UINT32 CBALLOC_AllocMsgs(void** msgs, UINT32 count);
+void CBALLOC_FreeMsg(void* ptr);
+
+// Get a statistics snapshot of the message pool followed by each size class.
+// Returns the number of ALLOC_Stats entries written, at most maxStats. Use 
+// the high-water marks and overflow counters to size the static block counts.
+UINT16 CBALLOC_GetStats(ALLOC_Stats* stats, UINT16 maxStats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,68 @@
+// Portable atomic operations for the C modules. Every operation is a full
+// memory barrier (sequentially consistent). AT_PAUSE() is a CPU hint for 
+// spin-wait loops. AT_YIELD() gives up the CPU for waits that may be long.
+
+#ifndef _ATOMIC_OPS_H
+#define _ATOMIC_OPS_H
+
+#include "DataTypes.h"
+
+#if WIN32
+    #include <intrin.h>
+
+    typedef volatile LONG ATOMIC_INT32;
+    typedef volatile LONGLONG ATOMIC_INT64;
+
+    #define AT_LOAD32(p)                    InterlockedCompareExchange((p), 0, 0)
+    #define AT_STORE32(p, v)                InterlockedExchange((p), (v))
+    #define AT_ADD32(p, v)                  (InterlockedExchangeAdd((p), (v)) + (v))
+    #define AT_CAS32(p, expected, desired)  \
+        (InterlockedCompareExchange((p), (desired), (expected)) == (expected))
+
+    #define AT_LOAD64(p)                    InterlockedCompareExchange64((p), 0, 0)
+    #define AT_STORE64(p, v)                InterlockedExchange64((p), (v))
+    #define AT_ADD64(p, v)                  (InterlockedExchangeAdd64((p), (v)) + (v))
+    #define AT_CAS64(p, expected, desired)  \
+        (InterlockedCompareExchange64((p), (desired), (expected)) == (expected))
+
+    #define AT_LOAD_PTR(p)                  InterlockedCompareExchangePointer((PVOID volatile*)(p), NULL, NULL)
+    #define AT_STORE_PTR(p, v)              InterlockedExchangePointer((PVOID volatile*)(p), (v))
+    #define AT_XCHG_PTR(p, v)               InterlockedExchangePointer((PVOID volatile*)(p), (v))
+    #define AT_CAS_PTR(p, expected, desired) \
+        (InterlockedCompareExchangePointer((PVOID volatile*)(p), (desired), (expected)) == (expected))
+
+    #define AT_PAUSE()                      YieldProcessor()
+    #define AT_YIELD()                      SwitchToThread()
+#else
+    #include <sched.h>
+
+    typedef volatile INT32 ATOMIC_INT32;
+    typedef volatile INT64 ATOMIC_INT64;
+
+    #define AT_LOAD32(p)                    __atomic_load_n((p), __ATOMIC_SEQ_CST)
+    #define AT_STORE32(p, v)                __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+    #define AT_ADD32(p, v)                  __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+    #define AT_CAS32(p, expected, desired)  __sync_bool_compare_and_swap((p), (expected), (desired))
+
+    #define AT_LOAD64(p)                    __atomic_load_n((p), __ATOMIC_SEQ_CST)
+    #define AT_STORE64(p, v)                __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+    #define AT_ADD64(p, v)                  __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+    #define AT_CAS64(p, expected, desired)  __sync_bool_compare_and_swap((p), (expected), (desired))
+
+    #define AT_LOAD_PTR(p)                  __atomic_load_n((p), __ATOMIC_SEQ_CST)
+    #define AT_STORE_PTR(p, v)              __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+    #define AT_XCHG_PTR(p, v)               __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+    #define AT_CAS_PTR(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+
+    #if defined(__i386__) || defined(__x86_64__)
+        #define AT_PAUSE()                  __builtin_ia32_pause()
+    #elif defined(__aarch64__) || defined(__arm__)
+        #define AT_PAUSE()                  __asm__ __volatile__("yield")
+    #else
+        #define AT_PAUSE()
+    #endif
+
+    #define AT_YIELD()                      sched_yield()
+#endif
+
+#endif // _ATOMIC_OPS_H
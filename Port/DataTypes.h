@@ -10,6 +10,8 @@
 	typedef unsigned short UINT16;
 	typedef unsigned int UINT32;
 	typedef int INT32;
+	typedef long long INT64;
+	typedef unsigned long long UINT64;
 	typedef char CHAR;
 	typedef short SHORT;
 	typedef long LONG;
@@ -0,0 +1,118 @@
+#ifndef _MPSC_RING_H
+#define _MPSC_RING_H
+
+#include "DataTypes.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// @brief A bounded, lock-free, multiple producer single consumer ring buffer.
+/// Each cell carries a sequence number so producers claim a slot with a single
+/// compare-and-swap and the consumer never takes a lock. The ring storage is
+/// allocated once at construction; push and pop never touch the heap.
+template <class T>
+class MpscRing
+{
+public:
+	/// Constructor
+	/// @param[in] capacity - the minimum number of ring entries. Rounded up to
+	///		the next power of two.
+	explicit MpscRing(size_t capacity) :
+		m_cells(0),
+		m_mask(0),
+		m_head(0),
+		m_tail(0)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size <<= 1;
+
+		m_cells = new Cell[size];
+		m_mask = size - 1;
+		for (size_t i = 0; i < size; i++)
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	~MpscRing() { delete[] m_cells; }
+
+	/// Add an entry to the ring. Safe to call from any number of threads.
+	/// @param[in] data - the entry to add
+	/// @return TRUE if added. FALSE if the ring is full.
+	BOOL TryPush(const T& data)
+	{
+		size_t pos = m_tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell* cell = &m_cells[pos & m_mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0)
+			{
+				// Slot is free. Claim it by advancing the tail.
+				if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell->data = data;
+					cell->seq.store(pos + 1, std::memory_order_release);
+					return TRUE;
+				}
+			}
+			else if (diff < 0)
+			{
+				// Slot not yet consumed. The ring is full.
+				return FALSE;
+			}
+			else
+			{
+				// Another producer claimed the slot. Reload the tail and retry.
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/// Remove the oldest entry from the ring. Only one thread may call TryPop().
+	/// @param[out] data - the removed entry
+	/// @return TRUE if an entry was removed. FALSE if the ring is empty.
+	BOOL TryPop(T& data)
+	{
+		size_t pos = m_head.load(std::memory_order_relaxed);
+		Cell* cell = &m_cells[pos & m_mask];
+		size_t seq = cell->seq.load(std::memory_order_acquire);
+		if ((intptr_t)seq - (intptr_t)(pos + 1) < 0)
+			return FALSE;
+
+		data = cell->data;
+		cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+		m_head.store(pos + 1, std::memory_order_relaxed);
+		return TRUE;
+	}
+
+	/// @return TRUE if the ring holds no published entries.
+	BOOL IsEmpty() const
+	{
+		size_t pos = m_head.load(std::memory_order_relaxed);
+		const Cell* cell = &m_cells[pos & m_mask];
+		return (intptr_t)cell->seq.load(std::memory_order_seq_cst) - (intptr_t)(pos + 1) < 0;
+	}
+
+	/// @return The number of ring entries.
+	size_t GetCapacity() const { return m_mask + 1; }
+
+private:
+	MpscRing(const MpscRing&);
+	MpscRing& operator=(const MpscRing&);
+
+	struct Cell
+	{
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	Cell* m_cells;
+	size_t m_mask;
+
+	// Consumer and producer indexes on separate cache lines
+	alignas(64) std::atomic<size_t> m_head;
+	alignas(64) std::atomic<size_t> m_tail;
+};
+
+#endif // _MPSC_RING_H
@@ -0,0 +1,133 @@
+#include "ShardedDispatchStd.h"
+#include "Fault.h"
+#include <new>
+
+using namespace std;
+
+//----------------------------------------------------------------------------
+// WT_CreateSharded
+//----------------------------------------------------------------------------
+extern "C" const CB_DispatchTarget* WT_CreateSharded(const CHAR* namePrefix,
+    size_t numWorkers, WT_KeyFuncType keyFunc)
+{
+    ShardedDispatcher* sharded = new (nothrow) ShardedDispatcher(keyFunc);
+    if (!sharded)
+        return NULL;
+
+    if (!sharded->CreateThreads(namePrefix, numWorkers))
+    {
+        delete sharded;
+        return NULL;
+    }
+
+    return sharded->GetDispatchTarget();
+}
+
+//----------------------------------------------------------------------------
+// WT_DestroySharded
+//----------------------------------------------------------------------------
+extern "C" void WT_DestroySharded(const CB_DispatchTarget* target)
+{
+    if (!target)
+        return;
+
+    // See WT_DestroyWorkers()
+    CB_SynchronizeAll();
+
+    delete static_cast<ShardedDispatcher*>(target->cbContext);
+}
+
+//----------------------------------------------------------------------------
+// ShardedDispatcher
+//----------------------------------------------------------------------------
+ShardedDispatcher::ShardedDispatcher(WT_KeyFuncType keyFunc) :
+	m_workers(0),
+	m_numWorkers(0),
+	m_keyFunc(keyFunc)
+{
+	m_target.cbDispatchFunc = &ShardedDispatcher::DispatchTarget;
+	m_target.cbContext = this;
+}
+
+//----------------------------------------------------------------------------
+// ~ShardedDispatcher
+//----------------------------------------------------------------------------
+ShardedDispatcher::~ShardedDispatcher()
+{
+	if (m_workers)
+		WT_DestroyWorkers(m_workers, m_numWorkers);
+	delete[] m_workers;
+}
+
+//----------------------------------------------------------------------------
+// CreateThreads
+//----------------------------------------------------------------------------
+BOOL ShardedDispatcher::CreateThreads(const CHAR* namePrefix, size_t numWorkers)
+{
+	ASSERT_TRUE(namePrefix);
+
+	if (m_workers || numWorkers == 0)
+		return FALSE;
+
+	m_workers = new (nothrow) const CB_DispatchTarget*[numWorkers];
+	if (!m_workers)
+		return FALSE;
+
+	// The unbounded MUTEX_QUEUE never rejects a message, so a chain split
+	// across workers is always queued in full
+	m_numWorkers = WT_CreateWorkers(namePrefix, numWorkers, m_workers);
+	return m_numWorkers == numWorkers;
+}
+
+//----------------------------------------------------------------------------
+// GetShard
+//----------------------------------------------------------------------------
+size_t ShardedDispatcher::GetShard(const CB_CallbackMsg* msg) const
+{
+	// A conflating registration's queued message carries no callback data. 
+	// Use its invoke key.
+	UINT32 key = (m_keyFunc && msg->cbData) ? m_keyFunc(msg->cbData) : msg->cbKey;
+
+	// Fibonacci hashing spreads sequential keys over the workers
+	return (size_t)((key * 2654435769u) >> 16) % m_numWorkers;
+}
+
+//----------------------------------------------------------------------------
+// DispatchTarget
+//----------------------------------------------------------------------------
+BOOL ShardedDispatcher::DispatchTarget(const CB_CallbackMsg* cbMsg, void* cbContext)
+{
+	return static_cast<ShardedDispatcher*>(cbContext)->DispatchCallback(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// DispatchCallback
+//----------------------------------------------------------------------------
+BOOL ShardedDispatcher::DispatchCallback(const CB_CallbackMsg* msg)
+{
+	CB_CallbackMsg* next = const_cast<CB_CallbackMsg*>(msg);
+	size_t nextShard;
+
+	if (m_numWorkers == 0)
+		return FALSE;
+
+	nextShard = GetShard(next);
+	while (next)
+	{
+		// Split a batch chain into runs of messages owned by the same worker
+		CB_CallbackMsg* first = next;
+		CB_CallbackMsg* last = first;
+		size_t shard = nextShard;
+
+		while (last->cbNext && (nextShard = GetShard(last->cbNext)) == shard)
+			last = last->cbNext;
+
+		next = last->cbNext;
+		last->cbNext = 0;
+
+		// Queue the run in order on the worker owning its key
+		BOOL queued = m_workers[shard]->cbDispatchFunc(first, m_workers[shard]->cbContext);
+		ASSERT_TRUE(queued);
+	}
+	return TRUE;
+}
@@ -0,0 +1,83 @@
+#ifndef _SHARDED_DISPATCH_STD_H
+#define _SHARDED_DISPATCH_STD_H
+
+#include "callback.h"
+#include "DataTypes.h"
+#include "WorkerThreadStd.h"
+
+// Get an ordering key from callback data. Return equal keys for callbacks
+// that must run in order, e.g. the same entity or state machine.
+typedef UINT32 (*WT_KeyFuncType)(const void* cbData);
+
+// C language interface to create a sharded dispatch target at runtime. e.g.
+//
+// const CB_DispatchTarget* target = WT_CreateSharded("Shard", 4, NULL);
+// CB_RegisterTarget(TestCb, TestCallback, target, NULL);
+// CB_InvokeParams params = { deviceId };
+// CB_InvokeEx(TestCb, &data, &params);
+// ...
+// WT_DestroySharded(target);
+
+/// Create a sharded dispatch target and start its worker threads.
+/// @param[in] namePrefix - worker thread name prefix
+/// @param[in] numWorkers - number of worker threads
+/// @param[in] keyFunc - gets the key from callback data. If NULL, the
+///		CB_InvokeParams key passed to CB_InvokeEx() is used. Conflating 
+///		registrations always use the CB_InvokeParams key.
+/// @return The dispatch target or NULL if out of memory.
+extern "C" const CB_DispatchTarget* WT_CreateSharded(const CHAR* namePrefix,
+	size_t numWorkers, WT_KeyFuncType keyFunc);
+
+/// Exit the worker threads and delete a target created by WT_CreateSharded().
+/// Unregister all callbacks from the target first. Waits for invokes like 
+/// WT_DestroyWorkers().
+/// @param[in] target - the dispatch target
+extern "C" void WT_DestroySharded(const CB_DispatchTarget* target);
+
+/// @brief A dispatch target hashing each message key onto one of N worker
+/// threads. Messages with equal keys and priority run in order on the same
+/// worker. Messages with different keys may run in parallel.
+class ShardedDispatcher
+{
+public:
+	/// Constructor
+	/// @param[in] keyFunc - gets the key from callback data. If NULL, the
+	///		message's invoke key is used.
+	ShardedDispatcher(WT_KeyFuncType keyFunc);
+
+	/// Destructor. Exits and deletes the worker threads.
+	~ShardedDispatcher();
+
+	/// Called once to create the worker threads
+	/// @param[in] namePrefix - worker thread name prefix
+	/// @param[in] numWorkers - the number of worker threads
+	/// @return TRUE if the threads are created. FALSE otherwise.
+	BOOL CreateThreads(const CHAR* namePrefix, size_t numWorkers);
+
+	/// Post a callback message, or a chain linked through cbNext, to the
+	/// worker thread owning each message's key
+	/// @return TRUE if the messages are queued.
+	BOOL DispatchCallback(const CB_CallbackMsg* msg);
+
+	/// Get the dispatch target to register callbacks with CB_RegisterTarget()
+	/// @return The dispatch target. Valid for the life of the instance.
+	const CB_DispatchTarget* GetDispatchTarget() const { return &m_target; }
+
+private:
+	ShardedDispatcher(const ShardedDispatcher&);
+	ShardedDispatcher& operator=(const ShardedDispatcher&);
+
+	/// @return The worker index owning the message's key
+	size_t GetShard(const CB_CallbackMsg* msg) const;
+
+	/// CB_DispatchTarget function. cbContext is the ShardedDispatcher instance.
+	static BOOL DispatchTarget(const CB_CallbackMsg* cbMsg, void* cbContext);
+
+	// Worker dispatch targets from WT_CreateWorkers()
+	const CB_DispatchTarget** m_workers;
+	size_t m_numWorkers;
+	WT_KeyFuncType m_keyFunc;
+	CB_DispatchTarget m_target;
+};
+
+#endif
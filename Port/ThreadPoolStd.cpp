@@ -0,0 +1,251 @@
+#include "ThreadPoolStd.h"
+#include "fb_allocator.h"
+#include "Fault.h"
+#include <new>
+#include <stdio.h>
+#if defined(__linux__)
+	#include <pthread.h>
+#endif
+
+using namespace std;
+
+static ThreadPool threadPool("Pool");
+
+//----------------------------------------------------------------------------
+// CreateThreadPool
+//----------------------------------------------------------------------------
+extern "C" void CreateThreadPool(size_t numWorkers)
+{
+    threadPool.CreateThreads(numWorkers);
+}
+
+//----------------------------------------------------------------------------
+// DispatchCallbackPool
+//----------------------------------------------------------------------------
+extern "C" BOOL DispatchCallbackPool(const CB_CallbackMsg* cbMsg)
+{
+    return threadPool.DispatchCallback(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// ThreadPool
+//----------------------------------------------------------------------------
+ThreadPool::ThreadPool(const CHAR* poolName) :
+	m_workers(0),
+	m_numWorkers(0),
+	m_next(0),
+	m_pending(0),
+	m_idle(0),
+	m_steals(0),
+	m_exit(false),
+	POOL_NAME(poolName)
+{
+	m_target.cbDispatchFunc = &ThreadPool::DispatchTarget;
+	m_target.cbContext = this;
+}
+
+//----------------------------------------------------------------------------
+// ~ThreadPool
+//----------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+	ExitThreads();
+}
+
+//----------------------------------------------------------------------------
+// CreateThreads
+//----------------------------------------------------------------------------
+BOOL ThreadPool::CreateThreads(size_t numWorkers)
+{
+	if (m_workers || numWorkers == 0)
+		return FALSE;
+
+	m_workers = new (nothrow) Worker[numWorkers];
+	if (!m_workers)
+		return FALSE;
+
+	m_numWorkers = numWorkers;
+	for (size_t idx = 0; idx < numWorkers; idx++)
+		m_workers[idx].thread = new thread(&ThreadPool::Process, this, idx);
+	return TRUE;
+}
+
+//----------------------------------------------------------------------------
+// ExitThreads
+//----------------------------------------------------------------------------
+void ThreadPool::ExitThreads()
+{
+	if (!m_workers)
+		return;
+
+	{
+		lock_guard<mutex> lk(m_idleMutex);
+		m_exit.store(true);
+	}
+	m_cv.notify_all();
+
+	// Refuse new messages, then wait for invokes that passed the m_exit check
+	// to finish linking messages. See WT_DestroyWorkers().
+	CB_SynchronizeAll();
+
+	for (size_t idx = 0; idx < m_numWorkers; idx++)
+	{
+		m_workers[idx].thread->join();
+		delete m_workers[idx].thread;
+	}
+
+	// Free messages still queued without invoking them
+	for (size_t idx = 0; idx < m_numWorkers; idx++)
+	{
+		CB_CallbackMsg* msg;
+		while ((msg = PopMsg(&m_workers[idx])) != 0)
+			CB_TargetDiscard(msg);
+	}
+
+	delete[] m_workers;
+	m_workers = 0;
+	m_numWorkers = 0;
+}
+
+//----------------------------------------------------------------------------
+// SetThreadName
+//----------------------------------------------------------------------------
+void ThreadPool::SetThreadName(size_t index)
+{
+#if defined(__linux__)
+	// Name each worker the pool name followed by its index. Linux thread 
+	// names are limited to 15 characters.
+	char name[16];
+	snprintf(name, sizeof(name), "%s%u", POOL_NAME, (unsigned int)index);
+	pthread_setname_np(pthread_self(), name);
+#else
+	(void)index;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// DispatchTarget
+//----------------------------------------------------------------------------
+BOOL ThreadPool::DispatchTarget(const CB_CallbackMsg* cbMsg, void* cbContext)
+{
+	return static_cast<ThreadPool*>(cbContext)->DispatchCallback(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// DispatchCallback
+//----------------------------------------------------------------------------
+BOOL ThreadPool::DispatchCallback(const CB_CallbackMsg* msg)
+{
+	// m_workers is valid until ExitThreads() waits out invokes that saw 
+	// m_exit clear
+	if (m_exit.load() || !m_workers)
+		return FALSE;
+
+	// The queue link lives within the pooled callback message
+	CB_CallbackMsg* first = const_cast<CB_CallbackMsg*>(msg);
+	CB_CallbackMsg* last = first;
+	size_t count = 1;
+
+	// Count the chain (see CB_RegisterBatch()) outside the lock
+	while (last->cbNext)
+	{
+		last = last->cbNext;
+		count++;
+	}
+
+	// Spread messages over the worker queues. Idle workers steal any imbalance.
+	Worker* worker = &m_workers[m_next.fetch_add(1, memory_order_relaxed) % m_numWorkers];
+	{
+		lock_guard<mutex> lk(worker->mutex);
+		if (worker->tail)
+			worker->tail->cbNext = first;
+		else
+			worker->head = first;
+		worker->tail = last;
+		m_pending.fetch_add(count);
+	}
+
+	// The m_pending increment precedes the m_idle check. Pairs with the m_idle
+	// increment in Process() so either the worker sees the messages or the 
+	// producer sees the parked worker.
+	if (m_idle.load() > 0)
+	{
+		lock_guard<mutex> lk(m_idleMutex);
+		m_cv.notify_one();
+	}
+	return TRUE;
+}
+
+//----------------------------------------------------------------------------
+// PopMsg
+//----------------------------------------------------------------------------
+CB_CallbackMsg* ThreadPool::PopMsg(Worker* worker)
+{
+	lock_guard<mutex> lk(worker->mutex);
+	CB_CallbackMsg* msg = worker->head;
+	if (msg)
+	{
+		worker->head = msg->cbNext;
+		if (!worker->head)
+			worker->tail = 0;
+		msg->cbNext = 0;
+		m_pending.fetch_sub(1);
+	}
+	return msg;
+}
+
+//----------------------------------------------------------------------------
+// GetMsg
+//----------------------------------------------------------------------------
+CB_CallbackMsg* ThreadPool::GetMsg(size_t index)
+{
+	// Own queue first
+	CB_CallbackMsg* msg = PopMsg(&m_workers[index]);
+	if (msg)
+		return msg;
+
+	// Steal from the other workers starting with the next neighbor
+	for (size_t offset = 1; offset < m_numWorkers; offset++)
+	{
+		msg = PopMsg(&m_workers[(index + offset) % m_numWorkers]);
+		if (msg)
+		{
+			m_steals.fetch_add(1, memory_order_relaxed);
+			return msg;
+		}
+	}
+	return 0;
+}
+
+//----------------------------------------------------------------------------
+// Process
+//----------------------------------------------------------------------------
+void ThreadPool::Process(size_t index)
+{
+	SetThreadName(index);
+
+	while (1)
+	{
+		CB_CallbackMsg* msg = GetMsg(index);
+		if (msg)
+		{
+			// Invoke the callback on this worker. The callback module frees
+			// the message.
+			CB_TargetInvoke(msg);
+			continue;
+		}
+
+		// No message on any queue. Park until a producer signals.
+		unique_lock<mutex> lk(m_idleMutex);
+		m_idle.fetch_add(1);
+		while (m_pending.load() == 0 && !m_exit.load())
+			m_cv.wait(lk);
+		m_idle.fetch_sub(1);
+
+		if (m_exit.load())
+			break;
+	}
+
+	// Return blocks cached by this thread to the shared pools
+	ALLOC_FlushMagazines();
+}
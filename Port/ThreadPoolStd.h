@@ -0,0 +1,109 @@
+#ifndef _THREAD_POOL_STD_H
+#define _THREAD_POOL_STD_H
+
+#include "callback.h"
+#include "DataTypes.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// C language interface to the thread pool dispatch function. Callbacks
+// registered with DispatchCallbackPool run on any pool worker, so callbacks of
+// one subscriber may run concurrently and out of order. Message priority is 
+// ignored.
+extern "C" void CreateThreadPool(size_t numWorkers);
+extern "C" BOOL DispatchCallbackPool(const CB_CallbackMsg* cbMsg);
+
+/// @brief A pool of worker threads dispatching callbacks. Each worker owns a
+/// mutex guarded intrusive FIFO. Producers spread messages round-robin over 
+/// the FIFOs. A worker whose FIFO is empty takes the head message of another
+/// worker's FIFO. There is no lock-free work-stealing deque.
+class ThreadPool
+{
+public:
+	/// Constructor
+	/// @param[in] poolName - the pool name. Each worker thread is named the pool
+	///		name followed by its index.
+	ThreadPool(const CHAR* poolName);
+
+	/// Destructor
+	~ThreadPool();
+
+	/// Called once to create the worker threads. Call before registering 
+	/// callbacks on the pool.
+	/// @param[in] numWorkers - the number of worker threads
+	/// @return TRUE if the threads are created. FALSE otherwise.
+	BOOL CreateThreads(size_t numWorkers);
+
+	/// Called once at program exit to exit the worker threads. Unregister all
+	/// callbacks from the pool first. Waits for invokes like WT_DestroyWorkers().
+	void ExitThreads();
+
+	/// Post a callback message, or a chain linked through cbNext, to the pool
+	/// @return TRUE if the messages are queued. FALSE if the pool is not created.
+	BOOL DispatchCallback(const CB_CallbackMsg* msg);
+
+	/// Get the dispatch target to register callbacks on this pool with
+	/// CB_RegisterTarget()
+	/// @return The dispatch target. Valid for the life of the instance.
+	const CB_DispatchTarget* GetDispatchTarget() const { return &m_target; }
+
+	/// Get the number of messages a worker took from another worker's queue
+	UINT64 GetStealCount() const { return m_steals.load(std::memory_order_relaxed); }
+
+private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	// One worker thread and its message queue
+	struct Worker
+	{
+		Worker() : thread(0), head(0), tail(0) {}
+
+		std::thread* thread;
+
+		// Intrusive queue linked through CB_CallbackMsg::cbNext
+		std::mutex mutex;
+		CB_CallbackMsg* head;
+		CB_CallbackMsg* tail;
+	};
+
+	/// Entry point for each worker thread
+	void Process(size_t index);
+
+	/// Name the calling worker thread after the pool
+	void SetThreadName(size_t index);
+
+	/// Remove the head message of a worker's queue and uncount it from 
+	/// m_pending
+	CB_CallbackMsg* PopMsg(Worker* worker);
+
+	/// Take a message from the worker's own queue or steal one from another
+	CB_CallbackMsg* GetMsg(size_t index);
+
+	/// CB_DispatchTarget function. cbContext is the ThreadPool instance.
+	static BOOL DispatchTarget(const CB_CallbackMsg* cbMsg, void* cbContext);
+
+	Worker* m_workers;
+	size_t m_numWorkers;
+
+	// Round-robin producer position
+	std::atomic<size_t> m_next;
+
+	// Messages linked into the worker queues. Changed under the queue's mutex
+	// so it never counts a message being invoked or not yet linked.
+	std::atomic<size_t> m_pending;
+
+	// Workers parked waiting for a message
+	std::atomic<size_t> m_idle;
+
+	std::atomic<UINT64> m_steals;
+	std::atomic<bool> m_exit;
+	std::mutex m_idleMutex;
+	std::condition_variable m_cv;
+	CB_DispatchTarget m_target;
+	const CHAR* POOL_NAME;
+};
+
+#endif
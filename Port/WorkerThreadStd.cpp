@@ -1,12 +1,30 @@
 #include "WorkerThreadStd.h"
-#include "ThreadMsg.h"
+#include "fb_allocator.h"
+#include "AtomicOps.h"
 #include "Fault.h"
+#include <chrono>
+#include <string.h>
+#include <stdio.h>
+#include <new>
+#if WIN32
+	// windows.h included by DataTypes.h
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
 
 using namespace std;
+using namespace std::chrono;
 
 #define MSG_DISPATCH_DELEGATE	1
 #define MSG_EXIT_THREAD			2
 
+// Pause instructions issued before WAIT_SPIN_THEN_PARK starts yielding
+#define SPIN_PAUSE_ITERATIONS	100
+
 static WorkerThread workerThread1("Thread1");
 static WorkerThread workerThread2("Thread2");
 
@@ -24,8 +42,7 @@ extern "C" void CreateThreads(void)
 //----------------------------------------------------------------------------
 extern "C" BOOL DispatchCallbackThread1(const CB_CallbackMsg* cbMsg)
 {
-    workerThread1.DispatchCallback(cbMsg);
-    return TRUE;
+    return workerThread1.DispatchCallback(cbMsg);
 }
 
 //----------------------------------------------------------------------------
@@ -33,15 +50,157 @@ extern "C" BOOL DispatchCallbackThread1(const CB_CallbackMsg* cbMsg)
 //----------------------------------------------------------------------------
 extern "C" BOOL DispatchCallbackThread2(const CB_CallbackMsg* cbMsg)
 {
-    workerThread2.DispatchCallback(cbMsg);
-    return TRUE;
+    return workerThread2.DispatchCallback(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// GetQueueStatsThread1
+//----------------------------------------------------------------------------
+extern "C" void GetQueueStatsThread1(WT_QueueStats* stats)
+{
+    workerThread1.GetQueueStats(stats);
+}
+
+//----------------------------------------------------------------------------
+// GetQueueStatsThread2
+//----------------------------------------------------------------------------
+extern "C" void GetQueueStatsThread2(WT_QueueStats* stats)
+{
+    workerThread2.GetQueueStats(stats);
+}
+
+//----------------------------------------------------------------------------
+// WT_GetCpuCount
+//----------------------------------------------------------------------------
+extern "C" size_t WT_GetCpuCount(void)
+{
+    unsigned int count = thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+//----------------------------------------------------------------------------
+// WT_CreateWorkers
+//----------------------------------------------------------------------------
+extern "C" size_t WT_CreateWorkers(const CHAR* namePrefix, size_t count, 
+    const CB_DispatchTarget** targets)
+{
+    size_t idx;
+
+    ASSERT_TRUE(namePrefix);
+    ASSERT_TRUE(targets || count == 0);
+
+    for (idx = 0; idx < count; idx++)
+    {
+        // The worker keeps a pointer to its name. WT_DestroyWorkers() frees it.
+        size_t len = strlen(namePrefix) + 24;
+        CHAR* name = new (nothrow) CHAR[len];
+        if (!name)
+            break;
+        snprintf(name, len, "%s%u", namePrefix, (unsigned int)idx);
+
+        WorkerThread* worker = new (nothrow) WorkerThread(name);
+        if (!worker)
+        {
+            delete[] name;
+            break;
+        }
+
+        worker->CreateThread();
+        targets[idx] = worker->GetDispatchTarget();
+    }
+
+    return idx;
+}
+
+//----------------------------------------------------------------------------
+// WT_DestroyWorkers
+//----------------------------------------------------------------------------
+extern "C" void WT_DestroyWorkers(const CB_DispatchTarget** targets, size_t count)
+{
+    ASSERT_TRUE(targets || count == 0);
+
+    // An invoke that took its snapshot before the caller unregistered may 
+    // still dispatch to a target. Wait for those invokes to finish.
+    CB_SynchronizeAll();
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        if (!targets[idx])
+            continue;
+
+        WorkerThread* worker = static_cast<WorkerThread*>(targets[idx]->cbContext);
+        const CHAR* name = worker->GetThreadName();
+
+        // The destructor exits the thread
+        delete worker;
+        delete[] name;
+        targets[idx] = NULL;
+    }
+}
+
+//----------------------------------------------------------------------------
+// Now
+//----------------------------------------------------------------------------
+static INT64 Now()
+{
+	return (INT64)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
 }
 
 //----------------------------------------------------------------------------
 // WorkerThread
 //----------------------------------------------------------------------------
-WorkerThread::WorkerThread(const CHAR* threadName) : m_thread(0), THREAD_NAME(threadName)
+WorkerThread::WorkerThread(const CHAR* threadName, QueueType queueType, size_t ringCapacity) : 
+	m_thread(0), 
+	m_maxBatchSize(DEFAULT_MAX_BATCH_SIZE),
+	m_starvationLimit(DEFAULT_STARVATION_LIMIT),
+	m_queueCapacity(0),
+	m_overflowPolicy(OVERFLOW_REJECT),
+	m_blockTimeoutMs(DEFAULT_BLOCK_TIMEOUT_MS),
+	m_waitingProducers(0),
+	m_rejected(0),
+	m_dropped(0),
+	m_blocked(0),
+	m_timeouts(0),
+	m_queueSize(0),
+	m_waitStrategy(WAIT_BLOCK),
+	m_spinMicroseconds(DEFAULT_SPIN_MICROSECONDS),
+	m_cpuMask(0),
+	m_schedPolicy(POLICY_DEFAULT),
+	m_schedPriority(0),
+	m_schedSet(FALSE),
+	m_latencyStats(FALSE),
+	m_latencyCount(0),
+	m_latencyTotalNs(0),
+	m_latencyMaxNs(0),
+	m_ring(0),
+	m_ringChain(0),
+	m_sleeping(false),
+	THREAD_NAME(threadName)
 {
+	for (int lane = 0; lane < CB_PRIORITY_LEVELS; lane++)
+	{
+		m_head[lane] = 0;
+		m_tail[lane] = 0;
+		m_laneSize[lane] = 0;
+		m_laneSkipped[lane] = 0;
+	}
+
+	if (queueType == RING_QUEUE)
+		m_ring = new MpscRing<CB_CallbackMsg*>(ringCapacity);
+
+	// The exit message is embedded so shutdown never allocates
+	m_exitMsg.cbFunc = NULL;
+	m_exitMsg.cbData = NULL;
+	m_exitMsg.cbUserData = NULL;
+	m_exitMsg.cbNext = NULL;
+	m_exitMsg.cbTimestamp = 0;
+	m_exitMsg.cbKey = 0;
+	m_exitMsg.cbPriority = CB_PRIORITY_DEFAULT;
+	m_exitMsg.cbMsgId = MSG_EXIT_THREAD;
+
+	// Dispatch target passing this instance as the context
+	m_target.cbDispatchFunc = &WorkerThread::DispatchTarget;
+	m_target.cbContext = this;
 }
 
 //----------------------------------------------------------------------------
@@ -50,6 +209,7 @@ WorkerThread::WorkerThread(const CHAR* threadName) : m_thread(0), THREAD_NAME(th
 WorkerThread::~WorkerThread()
 {
 	ExitThread();
+	delete m_ring;
 }
 
 //----------------------------------------------------------------------------
@@ -87,15 +247,9 @@ void WorkerThread::ExitThread()
 	if (!m_thread)
 		return;
 
-	// Create a new ThreadMsg
-	ThreadMsg* threadMsg = new ThreadMsg(MSG_EXIT_THREAD, 0);
-
-	// Put exit thread message into the queue
-	{
-		lock_guard<mutex> lock(m_mutex);
-		m_queue.push(threadMsg);
-		m_cv.notify_one();
-	}
+	// Put exit thread message into the queue. Wait for space if the ring is full.
+	while (!PostMsg(&m_exitMsg, &m_exitMsg, 1))
+		this_thread::yield();
 
 	m_thread->join();
 	delete m_thread;
@@ -105,72 +259,582 @@ void WorkerThread::ExitThread()
 //----------------------------------------------------------------------------
 // DispatchCallback
 //----------------------------------------------------------------------------
-void WorkerThread::DispatchCallback(const CB_CallbackMsg* msg)
+BOOL WorkerThread::DispatchCallback(const CB_CallbackMsg* msg)
 {
 	ASSERT_TRUE(m_thread);
 
-	// Create a new ThreadMsg
-	ThreadMsg* threadMsg = new ThreadMsg(MSG_DISPATCH_DELEGATE, msg);
+	// The queue link and message id live within the pooled callback message
+	CB_CallbackMsg* first = const_cast<CB_CallbackMsg*>(msg);
+	CB_CallbackMsg* last = first;
+	INT64 timestamp = m_latencyStats ? Now() : 0;
+	size_t count = 1;
+	last->cbMsgId = MSG_DISPATCH_DELEGATE;
+	last->cbTimestamp = timestamp;
 
-	// Add dispatch delegate msg to queue and notify worker thread
-	std::unique_lock<std::mutex> lk(m_mutex);
-	m_queue.push(threadMsg);
-	m_cv.notify_one();
+	// Stamp the rest of the chain outside the lock
+	while (last->cbNext)
+	{
+		last = last->cbNext;
+		last->cbMsgId = MSG_DISPATCH_DELEGATE;
+		last->cbTimestamp = timestamp;
+		count++;
+	}
+
+	// Add dispatch delegate msgs to queue and notify worker thread
+	return PostMsg(first, last, count);
 }
 
 //----------------------------------------------------------------------------
-// Process
+// DispatchTarget
 //----------------------------------------------------------------------------
-void WorkerThread::Process()
+BOOL WorkerThread::DispatchTarget(const CB_CallbackMsg* cbMsg, void* cbContext)
 {
-	while (1)
+	return static_cast<WorkerThread*>(cbContext)->DispatchCallback(cbMsg);
+}
+
+//----------------------------------------------------------------------------
+// PostMsg
+//----------------------------------------------------------------------------
+BOOL WorkerThread::PostMsg(CB_CallbackMsg* first, CB_CallbackMsg* last, size_t count)
+{
+	if (m_ring)
 	{
-		ThreadMsg* msg = 0;
+		// The chain occupies one ring entry. The worker walks it on pop.
+		if (!PushRing(first, count))
+			return FALSE;
+
+		// Only signal if the worker thread is parked on an empty ring. The fence
+		// orders the ring publish before the m_sleeping load (see WaitMsgs).
+		atomic_thread_fence(memory_order_seq_cst);
+		if (m_sleeping.load())
 		{
-			// Wait for a message to be added to the queue
-			std::unique_lock<std::mutex> lk(m_mutex);
-			while (m_queue.empty())
-				m_cv.wait(lk);
+			lock_guard<mutex> lk(m_mutex);
+			m_cv.notify_one();
+		}
+		return TRUE;
+	}
 
-			if (m_queue.empty())
-				continue;
+	last->cbNext = 0;
 
-			msg = m_queue.front();
-			m_queue.pop();
-		}
+	// A chain shares the priority of its first message
+	int lane = first->cbPriority < CB_PRIORITY_LEVELS ? first->cbPriority : CB_PRIORITY_LEVELS - 1;
+
+	CB_CallbackMsg* dropped = 0;
+	BOOL wake;
+	{
+		unique_lock<mutex> lk(m_mutex);
 
-		switch (msg->GetId())
+		// A bounded queue applies the overflow policy. The exit message is 
+		// never refused.
+		if (m_queueCapacity != 0 && first != &m_exitMsg && !MakeRoom(lk, lane, count, &dropped))
 		{
-			case MSG_DISPATCH_DELEGATE:
-			{
-				ASSERT_TRUE(msg->GetData() != NULL);
+			lk.unlock();
+			DiscardMsgs(dropped);
+			return FALSE;
+		}
 
-    			// Convert the ThreadMsg void* data back to a CB_CallbackMsg* 
-                const CB_CallbackMsg* callbackMsg = static_cast<const CB_CallbackMsg*>(msg->GetData());
+		// Splice the whole chain onto its lane at once
+		if (m_tail[lane])
+			m_tail[lane]->cbNext = first;
+		else
+			m_head[lane] = first;
+		m_tail[lane] = last;
+		m_laneSize[lane] += count;
+		m_queueSize.store(m_queueSize.load(memory_order_relaxed) + count, memory_order_relaxed);
+
+		// Only the first producer to find the worker parked signals it
+		wake = m_sleeping.load(memory_order_relaxed);
+		if (wake)
+			m_sleeping.store(false, memory_order_relaxed);
+	}
 
-				// Invoke the callback on the target thread
-                CB_TargetInvoke(callbackMsg);
+	// Signal after releasing the lock so the worker does not wake only to 
+	// block on the mutex
+	if (wake)
+		m_cv.notify_one();
+
+	// Free messages dropped to make room with no lock held
+	DiscardMsgs(dropped);
+	return TRUE;
+}
+
+//----------------------------------------------------------------------------
+// PushRing
+//----------------------------------------------------------------------------
+BOOL WorkerThread::PushRing(CB_CallbackMsg* first, size_t count)
+{
+	if (m_ring->TryPush(first))
+		return TRUE;
+
+	// ExitThread() retries the exit message itself
+	if (first == &m_exitMsg)
+		return FALSE;
+
+	// Ring producers never take the mutex, so a blocked producer polls for 
+	// space. Only the consumer can remove entries, so drop oldest rejects.
+	if (m_overflowPolicy != OVERFLOW_BLOCK)
+	{
+		m_rejected.fetch_add(count, memory_order_relaxed);
+		return FALSE;
+	}
 
-				// Delete dynamic data passed through message queue
-				delete msg;
-				break;
+	m_blocked.fetch_add(count, memory_order_relaxed);
+	steady_clock::time_point deadline = steady_clock::now() + milliseconds(m_blockTimeoutMs);
+	while (!m_ring->TryPush(first))
+	{
+		if (steady_clock::now() >= deadline)
+		{
+			m_timeouts.fetch_add(count, memory_order_relaxed);
+			return FALSE;
+		}
+		this_thread::yield();
+	}
+	return TRUE;
+}
+
+//----------------------------------------------------------------------------
+// MakeRoom
+//----------------------------------------------------------------------------
+BOOL WorkerThread::MakeRoom(unique_lock<mutex>& lk, int lane, size_t count, CB_CallbackMsg** dropped)
+{
+	// Caller must hold m_mutex
+	size_t size = m_queueSize.load(memory_order_relaxed);
+	if (size + count <= m_queueCapacity)
+		return TRUE;
+
+	// A chain larger than the whole queue can never fit
+	if (count <= m_queueCapacity)
+	{
+		if (m_overflowPolicy == OVERFLOW_DROP_OLDEST)
+		{
+			// Never drop a higher priority message for a lower priority one. 
+			// Never drop the exit message, it discards everything behind it 
+			// anyway. Count the droppable messages before dropping any.
+			size_t needed = size + count - m_queueCapacity;
+			size_t available = 0;
+			for (int dropLane = 0; dropLane <= lane && available < needed; dropLane++)
+			{
+				for (CB_CallbackMsg* msg = m_head[dropLane]; msg && msg != &m_exitMsg && available < needed; 
+					msg = msg->cbNext)
+					available++;
 			}
 
-			case MSG_EXIT_THREAD:
+			if (available == needed)
 			{
-				delete msg;
-				std::unique_lock<std::mutex> lk(m_mutex);
-				while (!m_queue.empty())
+				// Drop the oldest messages of the lowest priority lane first
+				CB_CallbackMsg* tail = 0;
+				int dropLane = 0;
+				while (needed > 0)
 				{
-					msg = m_queue.front();
-					m_queue.pop();
-					delete msg;
+					while (!m_head[dropLane] || m_head[dropLane] == &m_exitMsg)
+						dropLane++;
+
+					CB_CallbackMsg* msg = PopLane(dropLane, 1);
+					if (tail)
+						tail->cbNext = msg;
+					else
+						*dropped = msg;
+					tail = msg;
+					needed--;
+					m_dropped.fetch_add(1, memory_order_relaxed);
 				}
-				return;
+				return TRUE;
 			}
+		}
+		else if (m_overflowPolicy == OVERFLOW_BLOCK)
+		{
+			// The worker thread signals m_spaceCv after removing messages
+			m_blocked.fetch_add(count, memory_order_relaxed);
+			m_waitingProducers++;
+			BOOL fits = m_spaceCv.wait_for(lk, milliseconds(m_blockTimeoutMs), [&] {
+				return m_queueSize.load(memory_order_relaxed) + count <= m_queueCapacity; });
+			m_waitingProducers--;
+
+			if (fits)
+				return TRUE;
+			m_timeouts.fetch_add(count, memory_order_relaxed);
+			return FALSE;
+		}
+	}
 
-			default:
-				ASSERT();
+	m_rejected.fetch_add(count, memory_order_relaxed);
+	return FALSE;
+}
+
+//----------------------------------------------------------------------------
+// DiscardMsgs
+//----------------------------------------------------------------------------
+void WorkerThread::DiscardMsgs(CB_CallbackMsg* msg)
+{
+	while (msg)
+	{
+		CB_CallbackMsg* next = msg->cbNext;
+		msg->cbNext = 0;
+
+		// The callback module frees the message and its data
+		CB_TargetDiscard(msg);
+		msg = next;
+	}
+}
+
+//----------------------------------------------------------------------------
+// WaitMsgs
+//----------------------------------------------------------------------------
+CB_CallbackMsg* WorkerThread::WaitMsgs()
+{
+	CB_CallbackMsg* msg = 0;
+
+	// Optionally poll before parking to avoid the wakeup latency
+	if (m_waitStrategy != WAIT_BLOCK)
+		Spin();
+
+	if (m_ring)
+	{
+		// Lock-free pop. Only block when the ring is empty.
+		while ((msg = PopRing()) == 0)
+		{
+			unique_lock<mutex> lk(m_mutex);
+			m_sleeping.store(true);
+			while (m_ring->IsEmpty())
+				m_cv.wait(lk);
+			m_sleeping.store(false);
+		}
+		return msg;
+	}
+
+	// Wait for a message to be added to the queue. m_sleeping is guarded by 
+	// m_mutex here and tells producers a signal is needed.
+	unique_lock<mutex> lk(m_mutex);
+	while (m_queueSize.load(memory_order_relaxed) == 0)
+	{
+		m_sleeping.store(true, memory_order_relaxed);
+		m_cv.wait(lk);
+	}
+	m_sleeping.store(false, memory_order_relaxed);
+
+	// Take the pending messages in one locked step
+	CB_CallbackMsg* batch = PopBatch();
+
+	// Wake producers blocked on a full queue
+	BOOL space = m_waitingProducers != 0;
+	lk.unlock();
+	if (space)
+		m_spaceCv.notify_all();
+	return batch;
+}
+
+//----------------------------------------------------------------------------
+// TryGetMsg
+//----------------------------------------------------------------------------
+CB_CallbackMsg* WorkerThread::TryGetMsg()
+{
+	if (m_ring)
+		return PopRing();
+
+	unique_lock<mutex> lk(m_mutex);
+	CB_CallbackMsg* msg = PopMsg();
+
+	// Wake producers blocked on a full queue
+	BOOL space = m_waitingProducers != 0;
+	lk.unlock();
+	if (space)
+		m_spaceCv.notify_all();
+	return msg;
+}
+
+//----------------------------------------------------------------------------
+// PopMsg
+//----------------------------------------------------------------------------
+CB_CallbackMsg* WorkerThread::PopMsg()
+{
+	// Caller must hold m_mutex
+	return PopLane(SelectLane(), 1);
+}
+
+//----------------------------------------------------------------------------
+// PopBatch
+//----------------------------------------------------------------------------
+CB_CallbackMsg* WorkerThread::PopBatch()
+{
+	// Caller must hold m_mutex
+	return PopLane(SelectLane(), m_maxBatchSize);
+}
+
+//----------------------------------------------------------------------------
+// SelectLane
+//----------------------------------------------------------------------------
+int WorkerThread::SelectLane() const
+{
+	int selected = -1;
+
+	// Serve the highest non-empty lane unless a lower lane has waited past 
+	// the starvation limit
+	for (int lane = CB_PRIORITY_LEVELS - 1; lane >= 0; lane--)
+	{
+		if (!m_head[lane])
+			continue;
+		if (selected < 0)
+			selected = lane;
+		else if (m_starvationLimit != 0 && m_laneSkipped[lane] >= m_starvationLimit)
+			return lane;
+	}
+	return selected;
+}
+
+//----------------------------------------------------------------------------
+// PopLane
+//----------------------------------------------------------------------------
+CB_CallbackMsg* WorkerThread::PopLane(int lane, size_t maxCount)
+{
+	// Caller must hold m_mutex
+	if (lane < 0)
+		return 0;
+
+	CB_CallbackMsg* first = m_head[lane];
+	CB_CallbackMsg* last = m_tail[lane];
+	size_t count = m_laneSize[lane];
+
+	// Unlimited batches detach the whole lane without walking it
+	if (maxCount != 0 && count > maxCount)
+	{
+		last = first;
+		for (count = 1; count < maxCount; count++)
+			last = last->cbNext;
+	}
+
+	m_head[lane] = last->cbNext;
+	if (!m_head[lane])
+		m_tail[lane] = 0;
+	last->cbNext = 0;
+	m_laneSize[lane] -= count;
+	m_queueSize.store(m_queueSize.load(memory_order_relaxed) - count, memory_order_relaxed);
+
+	// Lower lanes still waiting age by the messages taken ahead of them
+	m_laneSkipped[lane] = 0;
+	for (int lower = 0; lower < lane; lower++)
+		m_laneSkipped[lower] = m_head[lower] ? m_laneSkipped[lower] + count : 0;
+	return first;
+}
+
+//----------------------------------------------------------------------------
+// HasMsg
+//----------------------------------------------------------------------------
+BOOL WorkerThread::HasMsg() const
+{
+	if (m_ring)
+		return m_ringChain != 0 || !m_ring->IsEmpty();
+	return m_queueSize.load(memory_order_relaxed) != 0;
+}
+
+//----------------------------------------------------------------------------
+// Spin
+//----------------------------------------------------------------------------
+void WorkerThread::Spin()
+{
+	steady_clock::time_point deadline = steady_clock::now() + microseconds(m_spinMicroseconds);
+	UINT32 iterations = 0;
+
+	while (!HasMsg())
+	{
+		// Busy-poll never parks. Spin-then-park pauses briefly, then yields 
+		// the CPU until the deadline expires.
+		if (m_waitStrategy == WAIT_BUSY_POLL || ++iterations < SPIN_PAUSE_ITERATIONS)
+		{
+			AT_PAUSE();
+		}
+		else
+		{
+			if (steady_clock::now() >= deadline)
+				return;
+			this_thread::yield();
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// SetSchedPolicy
+//----------------------------------------------------------------------------
+void WorkerThread::SetSchedPolicy(SchedPolicy policy, INT priority)
+{
+	m_schedPolicy = policy;
+	m_schedPriority = priority;
+	m_schedSet = TRUE;
+}
+
+//----------------------------------------------------------------------------
+// ApplyThreadOptions
+//----------------------------------------------------------------------------
+void WorkerThread::ApplyThreadOptions()
+{
+#if WIN32
+	if (m_cpuMask)
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)m_cpuMask);
+
+	if (m_schedSet)
+	{
+		// Windows has no FIFO class. Map to the highest priority levels.
+		int priority = (m_schedPolicy == POLICY_FIFO) ? THREAD_PRIORITY_TIME_CRITICAL :
+			(m_schedPriority < 0) ? THREAD_PRIORITY_ABOVE_NORMAL :
+			(m_schedPriority > 0) ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL;
+		SetThreadPriority(GetCurrentThread(), priority);
+	}
+#elif defined(__linux__)
+	// Linux thread names are limited to 15 characters
+	char name[16];
+	strncpy(name, THREAD_NAME, sizeof(name) - 1);
+	name[sizeof(name) - 1] = 0;
+	pthread_setname_np(pthread_self(), name);
+
+	if (m_cpuMask)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++)
+		{
+			if (m_cpuMask & ((UINT64)1 << cpu))
+				CPU_SET(cpu, &cpus);
+		}
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+
+	if (m_schedSet)
+	{
+		if (m_schedPolicy == POLICY_FIFO)
+		{
+			// Fails with EPERM unless the process may use real-time classes
+			sched_param param;
+			param.sched_priority = m_schedPriority;
+			pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		}
+		else
+		{
+			// The nice value of a Linux thread is set through its thread id
+			setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), m_schedPriority);
+		}
+	}
+#endif
+}
+
+//----------------------------------------------------------------------------
+// SetOverflowPolicy
+//----------------------------------------------------------------------------
+void WorkerThread::SetOverflowPolicy(OverflowPolicy policy, UINT32 blockTimeoutMs)
+{
+	m_overflowPolicy = policy;
+	m_blockTimeoutMs = blockTimeoutMs;
+}
+
+//----------------------------------------------------------------------------
+// GetQueueStats
+//----------------------------------------------------------------------------
+void WorkerThread::GetQueueStats(WT_QueueStats* stats) const
+{
+	ASSERT_TRUE(stats);
+	stats->rejected = m_rejected.load(memory_order_relaxed);
+	stats->dropped = m_dropped.load(memory_order_relaxed);
+	stats->blocked = m_blocked.load(memory_order_relaxed);
+	stats->timeouts = m_timeouts.load(memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// SetWaitStrategy
+//----------------------------------------------------------------------------
+void WorkerThread::SetWaitStrategy(WaitStrategy strategy, UINT32 spinMicroseconds)
+{
+	m_waitStrategy = strategy;
+	m_spinMicroseconds = spinMicroseconds;
+}
+
+//----------------------------------------------------------------------------
+// RecordLatency
+//----------------------------------------------------------------------------
+void WorkerThread::RecordLatency(const CB_CallbackMsg* msg)
+{
+	INT64 latency = Now() - msg->cbTimestamp;
+	UINT64 ns = latency > 0 ? (UINT64)latency : 0;
+
+	// Only the worker thread writes the statistics
+	m_latencyCount.store(m_latencyCount.load(memory_order_relaxed) + 1, memory_order_relaxed);
+	m_latencyTotalNs.store(m_latencyTotalNs.load(memory_order_relaxed) + ns, memory_order_relaxed);
+	if (ns > m_latencyMaxNs.load(memory_order_relaxed))
+		m_latencyMaxNs.store(ns, memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// GetLatencyStats
+//----------------------------------------------------------------------------
+void WorkerThread::GetLatencyStats(WT_LatencyStats* stats) const
+{
+	ASSERT_TRUE(stats);
+	stats->count = m_latencyCount.load(memory_order_relaxed);
+	stats->totalNs = m_latencyTotalNs.load(memory_order_relaxed);
+	stats->maxNs = m_latencyMaxNs.load(memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------
+// PopRing
+//----------------------------------------------------------------------------
+CB_CallbackMsg* WorkerThread::PopRing()
+{
+	// Finish a popped chain before taking the next ring entry
+	CB_CallbackMsg* msg = m_ringChain;
+	if (!msg && !m_ring->TryPop(msg))
+		return 0;
+
+	m_ringChain = msg->cbNext;
+	msg->cbNext = 0;
+	return msg;
+}
+
+//----------------------------------------------------------------------------
+// Process
+//----------------------------------------------------------------------------
+void WorkerThread::Process()
+{
+	ApplyThreadOptions();
+
+	while (1)
+	{
+		// Wait for messages to be added to the queue. Run the batch with no 
+		// lock held.
+		CB_CallbackMsg* batch = WaitMsgs();
+
+		while (batch)
+		{
+			CB_CallbackMsg* msg = batch;
+			batch = msg->cbNext;
+			msg->cbNext = 0;
+
+			switch (msg->cbMsgId)
+			{
+				case MSG_DISPATCH_DELEGATE:
+				{
+					if (m_latencyStats)
+						RecordLatency(msg);
+
+					// Invoke the callback on the target thread. The callback 
+					// module frees the message.
+					CB_TargetInvoke(msg);
+					break;
+				}
+
+				case MSG_EXIT_THREAD:
+				{
+					// Free the rest of the batch and any messages queued behind
+					// the exit message
+					DiscardMsgs(batch);
+					CB_CallbackMsg* discard;
+					while ((discard = TryGetMsg()) != 0)
+						CB_TargetDiscard(discard);
+
+					// Return blocks cached by this thread to the shared pools
+					ALLOC_FlushMagazines();
+					return;
+				}
+
+				default:
+					ASSERT();
+			}
 		}
 	}
 }
@@ -6,27 +6,130 @@
 
 #include "callback.h"
 #include "DataTypes.h"
+#include "MpscRing.h"
 #include <thread>
-#include <queue>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
 
+// Dispatch latency measured from DispatchCallback() to the start of the 
+// callback on the worker thread
+typedef struct
+{
+	/// Number of callbacks measured
+	UINT64 count;
+	/// Sum of all latencies in nanoseconds
+	UINT64 totalNs;
+	/// Largest latency in nanoseconds
+	UINT64 maxNs;
+} WT_LatencyStats;
+
+// Queue overflow counters. Each counts messages, not dispatch calls.
+typedef struct
+{
+	/// Messages refused because the queue was full
+	UINT64 rejected;
+	/// Queued messages freed to make room for newer messages
+	UINT64 dropped;
+	/// Messages whose dispatch waited for queue space
+	UINT64 blocked;
+	/// Messages refused after waiting the full block timeout
+	UINT64 timeouts;
+} WT_QueueStats;
+
 // C language interface to callback dispatch functions
 extern "C" void CreateThreads(void);
 extern "C" BOOL DispatchCallbackThread1(const CB_CallbackMsg* cbMsg);
 extern "C" BOOL DispatchCallbackThread2(const CB_CallbackMsg* cbMsg);
+extern "C" void GetQueueStatsThread1(WT_QueueStats* stats);
+extern "C" void GetQueueStatsThread2(WT_QueueStats* stats);
+
+// C language interface to create worker threads at runtime. Each worker is 
+// identified by its dispatch target. e.g.
+//
+// const CB_DispatchTarget* workers[8];
+// size_t count = WT_CreateWorkers("Worker", WT_GetCpuCount(), workers);
+// CB_RegisterTarget(TestCb, TestCallback, workers[0], NULL);
+// ...
+// WT_DestroyWorkers(workers, count);
+
+/// @return The number of CPUs available or 1 if unknown.
+extern "C" size_t WT_GetCpuCount(void);
+
+/// Create and start worker threads named namePrefix followed by an index.
+/// @param[in] namePrefix - thread name prefix
+/// @param[in] count - number of workers to create
+/// @param[out] targets - receives each worker's dispatch target
+/// @return The number of workers created.
+extern "C" size_t WT_CreateWorkers(const CHAR* namePrefix, size_t count, 
+	const CB_DispatchTarget** targets);
 
-class ThreadMsg;
+/// Exit and delete workers created by WT_CreateWorkers(). Unregister all 
+/// callbacks from the targets first. Calls CB_SynchronizeAll() to wait for 
+/// invokes still dispatching to a target, so never call from a synchronous 
+/// callback.
+/// @param[in] targets - the dispatch targets returned by WT_CreateWorkers()
+/// @param[in] count - number of targets
+extern "C" void WT_DestroyWorkers(const CB_DispatchTarget** targets, size_t count);
 
 class WorkerThread 
 {
 public:
+	/// Message queue implementation used by a WorkerThread instance
+	enum QueueType
+	{
+		/// Unbounded intrusive queue guarded by a mutex and condition variable
+		/// with one lane per message priority
+		MUTEX_QUEUE,
+		/// Bounded lock-free multiple producer single consumer ring buffer. 
+		/// Messages run in FIFO order regardless of priority.
+		RING_QUEUE
+	};
+
+	/// How the worker thread waits for a message when its queue is empty
+	enum WaitStrategy
+	{
+		/// Park on the condition variable immediately
+		WAIT_BLOCK,
+		/// Spin then yield for a bounded time, then park
+		WAIT_SPIN_THEN_PARK,
+		/// Poll without ever parking. Consumes a CPU core.
+		WAIT_BUSY_POLL
+	};
+
+	/// What DispatchCallback() does when the queue is full
+	enum OverflowPolicy
+	{
+		/// Refuse the new messages. The callback module frees them and 
+		/// CB_Invoke() returns FALSE if no subscriber accepted the data.
+		OVERFLOW_REJECT,
+		/// Free the oldest messages of the lowest priority lane to make room. 
+		/// Only lanes at or below the new messages' priority are dropped from;
+		/// if they cannot make room the new messages are refused. MUTEX_QUEUE 
+		/// only. A RING_QUEUE rejects instead.
+		OVERFLOW_DROP_OLDEST,
+		/// Wait up to a timeout for space, then refuse the new messages
+		OVERFLOW_BLOCK
+	};
+
+	/// Scheduling class applied to the worker thread at start
+	enum SchedPolicy
+	{
+		/// The OS default time-sharing class at a nice value
+		POLICY_DEFAULT,
+		/// Real-time first-in first-out class at a fixed priority
+		POLICY_FIFO
+	};
+
 	/// Constructor
-	WorkerThread(const CHAR* threadName);
+	/// @param[in] threadName - the thread name
+	/// @param[in] queueType - the message queue implementation
+	/// @param[in] ringCapacity - the RING_QUEUE entry count. Ignored for MUTEX_QUEUE.
+	WorkerThread(const CHAR* threadName, QueueType queueType = MUTEX_QUEUE, 
+		size_t ringCapacity = DEFAULT_RING_CAPACITY);
 
-	/// Destructor
-	~WorkerThread();
+	/// Destructor. Virtual because DispatchCallback() may be overridden.
+	virtual ~WorkerThread();
 
 	/// Called once to create the worker thread
 	/// @return TRUE if thread is created. FALSE otherise. 
@@ -41,7 +144,87 @@ public:
 	/// Get the ID of the currently executing thread
 	static std::thread::id GetCurrentThreadId();
 
-	virtual void DispatchCallback(const CB_CallbackMsg* msg);
+	/// Post a callback message, or a chain of messages linked through cbNext, 
+	/// to the worker thread. A chain is queued as a unit with one wakeup. A
+	/// MUTEX_QUEUE queues the chain on the priority lane of its first message.
+	/// @return TRUE if the messages are queued. FALSE if the queue is full.
+	virtual BOOL DispatchCallback(const CB_CallbackMsg* msg);
+
+	/// Set the maximum MUTEX_QUEUE messages the worker thread removes under 
+	/// one lock. Call before CreateThread().
+	/// @param[in] maxBatchSize - the batch limit. 0 removes all pending messages.
+	void SetMaxBatchSize(size_t maxBatchSize) { m_maxBatchSize = maxBatchSize; }
+
+	/// Set the MUTEX_QUEUE starvation limit. Higher priority lanes run first. 
+	/// Once this many messages run while a lower lane waits, the worker thread 
+	/// takes one batch from the waiting lane. Call before CreateThread().
+	/// @param[in] starvationLimit - the message limit. 0 runs lanes in strict 
+	///		priority order.
+	void SetStarvationLimit(size_t starvationLimit) { m_starvationLimit = starvationLimit; }
+
+	/// Limit the number of MUTEX_QUEUE messages. A RING_QUEUE is bounded by its 
+	/// ring capacity. Call before CreateThread().
+	/// @param[in] queueCapacity - the message limit. 0 is unbounded.
+	void SetQueueCapacity(size_t queueCapacity) { m_queueCapacity = queueCapacity; }
+
+	/// Set how a full queue handles new messages. Call before CreateThread(). 
+	/// A callback posting to its own full worker with OVERFLOW_BLOCK waits the
+	/// whole timeout.
+	/// @param[in] policy - the overflow policy
+	/// @param[in] blockTimeoutMs - OVERFLOW_BLOCK maximum wait in milliseconds
+	void SetOverflowPolicy(OverflowPolicy policy, UINT32 blockTimeoutMs = DEFAULT_BLOCK_TIMEOUT_MS);
+
+	/// Get the queue overflow counters. Safe to call from any thread.
+	/// @param[out] stats - the overflow counters
+	void GetQueueStats(WT_QueueStats* stats) const;
+
+	/// Set how the worker thread waits for messages. Call before CreateThread().
+	/// @param[in] strategy - the wait strategy
+	/// @param[in] spinMicroseconds - WAIT_SPIN_THEN_PARK time before parking
+	void SetWaitStrategy(WaitStrategy strategy, UINT32 spinMicroseconds = DEFAULT_SPIN_MICROSECONDS);
+
+	/// Pin the worker thread to a set of CPUs. Call before CreateThread().
+	/// @param[in] cpuMask - bit n set allows CPU n. 0 leaves affinity unchanged.
+	void SetCpuAffinity(UINT64 cpuMask) { m_cpuMask = cpuMask; }
+
+	/// Set the worker thread scheduling class. Call before CreateThread(). A 
+	/// setting the OS does not permit, such as a real-time class without 
+	/// privilege, is ignored.
+	/// @param[in] policy - the scheduling class
+	/// @param[in] priority - the POLICY_FIFO priority (1 to 99 on Linux) or the 
+	///		POLICY_DEFAULT nice value (-20 to 19 on Linux)
+	void SetSchedPolicy(SchedPolicy policy, INT priority);
+
+	/// Enable dispatch latency measurement. Call before CreateThread().
+	/// @param[in] enable - TRUE to timestamp and measure every message
+	void EnableLatencyStats(BOOL enable) { m_latencyStats = enable; }
+
+	/// Get the dispatch latency statistics. Safe to call from any thread.
+	/// @param[out] stats - the latency statistics
+	void GetLatencyStats(WT_LatencyStats* stats) const;
+
+	/// Get the dispatch target to register callbacks on this worker with 
+	/// CB_RegisterTarget()
+	/// @return The dispatch target. Valid for the life of the instance.
+	const CB_DispatchTarget* GetDispatchTarget() const { return &m_target; }
+
+	/// Get the thread name
+	const CHAR* GetThreadName() const { return THREAD_NAME; }
+
+	/// Default WAIT_SPIN_THEN_PARK spin time
+	static const UINT32 DEFAULT_SPIN_MICROSECONDS = 50;
+
+	/// Default RING_QUEUE entry count
+	static const size_t DEFAULT_RING_CAPACITY = 1024;
+
+	/// Default maximum messages removed from the MUTEX_QUEUE under one lock
+	static const size_t DEFAULT_MAX_BATCH_SIZE = 64;
+
+	/// Default OVERFLOW_BLOCK maximum wait
+	static const UINT32 DEFAULT_BLOCK_TIMEOUT_MS = 100;
+
+	/// Default higher priority messages run while a lower lane waits
+	static const size_t DEFAULT_STARVATION_LIMIT = 256;
 
 private:
 	WorkerThread(const WorkerThread&);
@@ -50,8 +233,119 @@ private:
 	/// Entry point for the thread
 	void Process();
 
+	/// CB_DispatchTarget function. cbContext is the WorkerThread instance.
+	static BOOL DispatchTarget(const CB_CallbackMsg* cbMsg, void* cbContext);
+
+	/// Add the count linked messages first through last to the queue and wake
+	/// the worker thread
+	BOOL PostMsg(CB_CallbackMsg* first, CB_CallbackMsg* last, size_t count);
+
+	/// Push a message chain onto the RING_QUEUE applying the overflow policy
+	BOOL PushRing(CB_CallbackMsg* first, size_t count);
+
+	/// Make room for count MUTEX_QUEUE messages applying the overflow policy.
+	/// Caller must hold m_mutex through lk.
+	/// @param[in] lane - the priority lane of the new messages
+	/// @param[in] count - the number of new messages
+	/// @param[out] dropped - receives dropped messages linked through cbNext
+	/// @return TRUE if the messages fit.
+	BOOL MakeRoom(std::unique_lock<std::mutex>& lk, int lane, size_t count, CB_CallbackMsg** dropped);
+
+	/// Free messages linked through cbNext without invoking them
+	static void DiscardMsgs(CB_CallbackMsg* msg);
+
+	/// Apply the name, CPU affinity and scheduling class to the calling thread
+	void ApplyThreadOptions();
+
+	/// Poll for a message before parking according to the wait strategy
+	void Spin();
+
+	/// @return TRUE if a message is pending. Called by the worker thread only.
+	BOOL HasMsg() const;
+
+	/// Record the dispatch latency of a message about to be invoked
+	void RecordLatency(const CB_CallbackMsg* msg);
+
+	/// Wait for and remove the next batch of messages from the queue
+	/// @return The first message of a batch linked through cbNext.
+	CB_CallbackMsg* WaitMsgs();
+
+	/// Remove the next message from the queue without waiting
+	CB_CallbackMsg* TryGetMsg();
+
+	/// Unlink the MUTEX_QUEUE head message. Caller must hold m_mutex.
+	CB_CallbackMsg* PopMsg();
+
+	/// Unlink up to m_maxBatchSize MUTEX_QUEUE messages. Caller must hold m_mutex.
+	CB_CallbackMsg* PopBatch();
+
+	/// Choose the MUTEX_QUEUE lane to serve next. Caller must hold m_mutex.
+	/// @return The lane index or -1 if the queue is empty.
+	int SelectLane() const;
+
+	/// Unlink up to maxCount messages from a lane. 0 unlinks the whole lane. 
+	/// Caller must hold m_mutex.
+	CB_CallbackMsg* PopLane(int lane, size_t maxCount);
+
+	/// Remove the next RING_QUEUE message. Called by the worker thread only.
+	CB_CallbackMsg* PopRing();
+
 	std::thread* m_thread;
-	std::queue<ThreadMsg*> m_queue;
+
+	// Intrusive MUTEX_QUEUE linked through CB_CallbackMsg::cbNext. One lane 
+	// per message priority.
+	CB_CallbackMsg* m_head[CB_PRIORITY_LEVELS];
+	CB_CallbackMsg* m_tail[CB_PRIORITY_LEVELS];
+	size_t m_laneSize[CB_PRIORITY_LEVELS];
+	size_t m_maxBatchSize;
+
+	// Higher priority messages run while each lane waited. Guarded by m_mutex.
+	size_t m_laneSkipped[CB_PRIORITY_LEVELS];
+	size_t m_starvationLimit;
+
+	// Queue bound and overflow handling
+	size_t m_queueCapacity;
+	OverflowPolicy m_overflowPolicy;
+	UINT32 m_blockTimeoutMs;
+
+	// Producers waiting on m_spaceCv for MUTEX_QUEUE space. Guarded by m_mutex.
+	size_t m_waitingProducers;
+	std::condition_variable m_spaceCv;
+
+	// Overflow counters
+	std::atomic<UINT64> m_rejected;
+	std::atomic<UINT64> m_dropped;
+	std::atomic<UINT64> m_blocked;
+	std::atomic<UINT64> m_timeouts;
+
+	// Number of MUTEX_QUEUE messages. Written under m_mutex, read lock-free 
+	// while spinning.
+	std::atomic<size_t> m_queueSize;
+
+	WaitStrategy m_waitStrategy;
+	UINT32 m_spinMicroseconds;
+
+	// Thread options applied at thread start
+	UINT64 m_cpuMask;
+	SchedPolicy m_schedPolicy;
+	INT m_schedPriority;
+	BOOL m_schedSet;
+
+	// Latency statistics. Written by the worker thread only.
+	BOOL m_latencyStats;
+	std::atomic<UINT64> m_latencyCount;
+	std::atomic<UINT64> m_latencyTotalNs;
+	std::atomic<UINT64> m_latencyMaxNs;
+
+	MpscRing<CB_CallbackMsg*>* m_ring;
+
+	// Remainder of a message chain popped from the ring. Worker thread only.
+	CB_CallbackMsg* m_ringChain;
+	CB_CallbackMsg m_exitMsg;
+	CB_DispatchTarget m_target;
+	// TRUE while the worker thread is parked waiting for a message. Producers 
+	// only signal m_cv when set.
+	std::atomic<bool> m_sleeping;
 	std::mutex m_mutex;
 	std::condition_variable m_cv;
 	const CHAR* THREAD_NAME;
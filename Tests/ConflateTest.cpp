@@ -0,0 +1,122 @@
+#include "callback.h"
+#include "fb_allocator.h"
+#include "WorkerThreadStd.h"
+#include "TestUtil.h"
+#include <atomic>
+#include <thread>
+
+// ConflateTest.cpp
+// Conflating registrations across unregister and a full target queue.
+
+using namespace std;
+
+// Maximum allowed registered callbacks
+#define MAX_REGISTER  2
+
+// Conflated value under test
+CB_DECLARE(ValueCb, const int*)
+CB_DEFINE_CONFLATE(ValueCb, const int*, sizeof(int), MAX_REGISTER)
+
+static atomic<int> valueCount(0);
+static atomic<int> lastValue(0);
+static thread::id valueThread;
+
+static void ValueCallback(const int* data, void* userData)
+{
+    valueThread = this_thread::get_id();
+    lastValue = *data;
+    valueCount++;
+}
+
+//----------------------------------------------------------------------------
+// TestReregister
+//----------------------------------------------------------------------------
+static void TestReregister(WorkerThread& oldWorker, WorkerThread& newWorker)
+{
+    int value = 1;
+    valueCount = 0;
+
+    // Queue a trigger on the blocked old worker
+    CloseGate(oldWorker);
+    CB_RegisterTargetConflate(ValueCb, ValueCallback, oldWorker.GetDispatchTarget(), NULL);
+    TEST_CHECK(CB_Invoke(ValueCb, &value) == TRUE);
+
+    // Move the subscriber while the trigger is still queued
+    CB_UnregisterTarget(ValueCb, ValueCallback, oldWorker.GetDispatchTarget());
+    CB_Synchronize(ValueCb);
+    CB_RegisterTargetConflate(ValueCb, ValueCallback, newWorker.GetDispatchTarget(), NULL);
+
+    // The new registration is not absorbed by the pending trigger
+    value = 2;
+    TEST_CHECK(CB_Invoke(ValueCb, &value) == TRUE);
+    TEST_CHECK(TestWaitFor([] { return valueCount == 1; }));
+    TEST_CHECK(lastValue == 2);
+    TEST_CHECK(valueThread == newWorker.GetThreadId());
+
+    // The withdrawn trigger runs nothing on the old worker
+    OpenGate(oldWorker, 0);
+    TEST_CHECK(valueCount == 1);
+
+    value = 3;
+    TEST_CHECK(CB_Invoke(ValueCb, &value) == TRUE);
+    TEST_CHECK(TestWaitFor([] { return valueCount == 2; }));
+    TEST_CHECK(lastValue == 3);
+    TEST_CHECK(valueThread == newWorker.GetThreadId());
+
+    CB_UnregisterTarget(ValueCb, ValueCallback, newWorker.GetDispatchTarget());
+    CB_Synchronize(ValueCb);
+}
+
+//----------------------------------------------------------------------------
+// TestQueueFull
+//----------------------------------------------------------------------------
+static void TestQueueFull(WorkerThread& fullWorker)
+{
+    int value = 10;
+    valueCount = 0;
+
+    // A second gate message fills the one message queue
+    CloseGate(fullWorker);
+    TEST_CHECK(PostGate(fullWorker) == TRUE);
+
+    // The trigger is rejected and the data withdrawn
+    CB_RegisterTargetConflate(ValueCb, ValueCallback, fullWorker.GetDispatchTarget(), NULL);
+    TEST_CHECK(CB_Invoke(ValueCb, &value) == FALSE);
+    OpenGate(fullWorker, 1);
+    TEST_CHECK(valueCount == 0);
+
+    // The next invoke queues a new trigger
+    value = 11;
+    TEST_CHECK(CB_Invoke(ValueCb, &value) == TRUE);
+    TEST_CHECK(TestWaitFor([] { return valueCount == 1; }));
+    TEST_CHECK(lastValue == 11);
+
+    CB_UnregisterTarget(ValueCb, ValueCallback, fullWorker.GetDispatchTarget());
+    CB_Synchronize(ValueCb);
+}
+
+int main()
+{
+    ALLOC_Init();
+    CB_Init();
+
+    WorkerThread worker1("Conflate1");
+    WorkerThread worker2("Conflate2");
+    WorkerThread fullWorker("ConflateFull");
+    fullWorker.SetQueueCapacity(1);
+    worker1.CreateThread();
+    worker2.CreateThread();
+    fullWorker.CreateThread();
+
+    TestReregister(worker1, worker2);
+    TestReregister(worker2, worker1);
+    TestQueueFull(fullWorker);
+
+    worker1.ExitThread();
+    worker2.ExitThread();
+    fullWorker.ExitThread();
+
+    CB_Term();
+    ALLOC_Term();
+    return TEST_RESULT();
+}
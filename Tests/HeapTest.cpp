@@ -0,0 +1,174 @@
+#include "callback.h"
+#include "fb_allocator.h"
+#include "WorkerThreadStd.h"
+#include "TestUtil.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+// HeapTest.cpp
+// Count heap allocations during CB_Invoke() to verify the dispatch path
+// obtains all storage from the callback fixed block allocator. Counts global
+// operator new. Also counts malloc(), calloc() and realloc() called by any
+// library when HEAP_WRAP_MALLOC is defined and the linker wraps them.
+
+using namespace std;
+
+// Maximum allowed registered callbacks
+#define MAX_REGISTER    3
+
+// Invokes measured per test
+#define HEAP_INVOKES    100
+
+// Heap allocations made while heapCounting is set
+static atomic<bool> heapCounting(false);
+static atomic<unsigned long> heapAllocations(0);
+
+#ifdef HEAP_WRAP_MALLOC
+extern "C" void* __real_malloc(size_t size);
+extern "C" void* __real_calloc(size_t num, size_t size);
+extern "C" void* __real_realloc(void* ptr, size_t size);
+
+extern "C" void* __wrap_malloc(size_t size)
+{
+    if (heapCounting.load(memory_order_relaxed))
+        heapAllocations++;
+    return __real_malloc(size);
+}
+
+extern "C" void* __wrap_calloc(size_t num, size_t size)
+{
+    if (heapCounting.load(memory_order_relaxed))
+        heapAllocations++;
+    return __real_calloc(num, size);
+}
+
+extern "C" void* __wrap_realloc(void* ptr, size_t size)
+{
+    if (heapCounting.load(memory_order_relaxed))
+        heapAllocations++;
+    return __real_realloc(ptr, size);
+}
+
+#define HEAP_MALLOC(size)   __real_malloc(size)
+#else
+#define HEAP_MALLOC(size)   malloc(size)
+#endif
+
+void* operator new(size_t size)
+{
+    if (heapCounting.load(memory_order_relaxed))
+        heapAllocations++;
+    void* ptr = HEAP_MALLOC(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// Callback data larger than CB_INLINE_DATA_SIZE
+struct LargeData
+{
+    char data[CB_INLINE_DATA_SIZE * 4];
+};
+
+CB_DECLARE(SmallCb, const int*)
+CB_DEFINE(SmallCb, const int*, sizeof(int), MAX_REGISTER)
+
+CB_DECLARE(LargeCb, const LargeData*)
+CB_DEFINE(LargeCb, const LargeData*, sizeof(LargeData), MAX_REGISTER)
+
+static atomic<int> callbackCount(0);
+
+static void SmallCallback(const int* data, void* userData)
+{
+    callbackCount++;
+}
+
+static void LargeCallback(const LargeData* data, void* userData)
+{
+    callbackCount++;
+}
+
+//----------------------------------------------------------------------------
+// CountInvokeAllocations
+//----------------------------------------------------------------------------
+template <class Invoke>
+static unsigned long CountInvokeAllocations(Invoke invoke, int subscribers)
+{
+    // Warm up the allocator pools and worker queues outside the count
+    callbackCount = 0;
+    invoke();
+    TEST_CHECK(TestWaitFor([&] { return callbackCount == subscribers; }));
+
+    callbackCount = 0;
+    heapAllocations = 0;
+    heapCounting = true;
+    for (int count = 0; count < HEAP_INVOKES; count++)
+    {
+        invoke();
+
+        // Stay within the callback message pool
+        TestWaitFor([&] { return callbackCount == (count + 1) * subscribers; });
+    }
+    heapCounting = false;
+    TEST_CHECK(callbackCount == HEAP_INVOKES * subscribers);
+    return heapAllocations;
+}
+
+//----------------------------------------------------------------------------
+// TestInvokeHeap
+//----------------------------------------------------------------------------
+static void TestInvokeHeap(WorkerThread& worker1, WorkerThread& worker2)
+{
+    int small = 123;
+    LargeData large = { { 0 } };
+
+    // One synchronous and two asynchronous subscribers share each invoke
+    CB_Register(SmallCb, SmallCallback, NULL, NULL);
+    CB_RegisterTarget(SmallCb, SmallCallback, worker1.GetDispatchTarget(), NULL);
+    CB_RegisterTarget(SmallCb, SmallCallback, worker2.GetDispatchTarget(), NULL);
+    CB_Register(LargeCb, LargeCallback, NULL, NULL);
+    CB_RegisterTarget(LargeCb, LargeCallback, worker1.GetDispatchTarget(), NULL);
+    CB_RegisterTarget(LargeCb, LargeCallback, worker2.GetDispatchTarget(), NULL);
+
+    TEST_CHECK(CountInvokeAllocations([&] { CB_Invoke(SmallCb, &small); }, 3) == 0);
+    TEST_CHECK(CountInvokeAllocations([&] { CB_Invoke(LargeCb, &large); }, 3) == 0);
+
+    CB_Unregister(SmallCb, SmallCallback, NULL);
+    CB_UnregisterTarget(SmallCb, SmallCallback, worker1.GetDispatchTarget());
+    CB_UnregisterTarget(SmallCb, SmallCallback, worker2.GetDispatchTarget());
+    CB_Unregister(LargeCb, LargeCallback, NULL);
+    CB_UnregisterTarget(LargeCb, LargeCallback, worker1.GetDispatchTarget());
+    CB_UnregisterTarget(LargeCb, LargeCallback, worker2.GetDispatchTarget());
+    CB_SynchronizeAll();
+}
+
+int main()
+{
+    ALLOC_Init();
+    CB_Init();
+
+    WorkerThread worker1("Heap1");
+    WorkerThread worker2("Heap2");
+    worker1.CreateThread();
+    worker2.CreateThread();
+
+    TestInvokeHeap(worker1, worker2);
+
+    worker1.ExitThread();
+    worker2.ExitThread();
+
+    CB_Term();
+    ALLOC_Term();
+    return TEST_RESULT();
+}
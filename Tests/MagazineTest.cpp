@@ -0,0 +1,61 @@
+#include "fb_allocator.h"
+#include "TestUtil.h"
+#include <thread>
+
+// MagazineTest.cpp
+// Blocks cached within thread-local magazines return to the shared pool.
+
+using namespace std;
+
+// Fixed pool size. Each exiting thread caches up to ALLOC_MAGAZINE_SIZE blocks.
+#define POOL_BLOCKS     32
+#define THREAD_BLOCKS   20
+#define THREADS         5
+
+ALLOC_DEFINE(magAlloc, 32, POOL_BLOCKS)
+
+//----------------------------------------------------------------------------
+// TestThreadExit
+//----------------------------------------------------------------------------
+static void TestThreadExit()
+{
+    ALLOC_Stats stats;
+
+    // Each thread leaves blocks within its magazine and exits without calling
+    // ALLOC_FlushMagazines()
+    for (int idx = 0; idx < THREADS; idx++)
+    {
+        thread worker([] {
+            void* blocks[THREAD_BLOCKS];
+            for (int block = 0; block < THREAD_BLOCKS; block++)
+                blocks[block] = ALLOC_Alloc(magAlloc, 32);
+            for (int block = 0; block < THREAD_BLOCKS; block++)
+                ALLOC_Free(magAlloc, blocks[block]);
+        });
+        worker.join();
+    }
+
+    // Every block of the fixed pool is still available
+    void* blocks[POOL_BLOCKS];
+    for (int block = 0; block < POOL_BLOCKS; block++)
+    {
+        blocks[block] = ALLOC_Alloc(magAlloc, 32);
+        TEST_CHECK(blocks[block] != NULL);
+    }
+    for (int block = 0; block < POOL_BLOCKS; block++)
+        ALLOC_Free(magAlloc, blocks[block]);
+
+    ALLOC_GetStats(magAlloc, &stats);
+    TEST_CHECK(stats.blocksInUse == 0);
+}
+
+int main()
+{
+    ALLOC_Init();
+    ALLOC_EnableMagazine(magAlloc);
+
+    TestThreadExit();
+
+    ALLOC_Term();
+    return TEST_RESULT();
+}
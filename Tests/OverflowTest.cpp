@@ -0,0 +1,114 @@
+#include "callback.h"
+#include "fb_allocator.h"
+#include "WorkerThreadStd.h"
+#include "TestUtil.h"
+#include <atomic>
+#include <vector>
+
+// OverflowTest.cpp
+// Bounded WorkerThread queue overflow policies.
+
+using namespace std;
+
+// Maximum allowed registered callbacks
+#define MAX_REGISTER  2
+
+// Messages the bounded queue holds
+#define QUEUE_CAPACITY  2
+
+CB_DECLARE(ValueCb, const int*)
+CB_DEFINE(ValueCb, const int*, sizeof(int), MAX_REGISTER)
+
+// Values in delivery order. Written by the worker thread only.
+static vector<int> delivered;
+static atomic<int> valueCount(0);
+
+static void ValueCallback(const int* data, void* userData)
+{
+    delivered.push_back(*data);
+    valueCount++;
+}
+
+// Invoke ValueCb with a message priority
+static BOOL InvokeValue(int value, UINT16 priority)
+{
+    CB_InvokeParams params;
+    params.cbKey = 0;
+    params.cbPriority = priority;
+    return CB_InvokeEx(ValueCb, &value, &params);
+}
+
+// Release the blocked worker and wait for count callbacks
+static void Drain(int count)
+{
+    gateOpen = true;
+    TEST_CHECK(TestWaitFor([&] { return valueCount == count; }));
+}
+
+//----------------------------------------------------------------------------
+// TestDropOldest
+//----------------------------------------------------------------------------
+static void TestDropOldest(WorkerThread& worker)
+{
+    WT_QueueStats stats;
+    delivered.clear();
+    valueCount = 0;
+
+    CB_RegisterTarget(ValueCb, ValueCallback, worker.GetDispatchTarget(), NULL);
+
+    // Fill the queue with urgent messages
+    CloseGate(worker);
+    TEST_CHECK(InvokeValue(1, CB_PRIORITY_URGENT) == TRUE);
+    TEST_CHECK(InvokeValue(2, CB_PRIORITY_URGENT) == TRUE);
+
+    // Lower priority messages never displace urgent ones
+    TEST_CHECK(InvokeValue(3, CB_PRIORITY_DEFAULT) == FALSE);
+    TEST_CHECK(InvokeValue(4, CB_PRIORITY_HIGH) == FALSE);
+    worker.GetQueueStats(&stats);
+    TEST_CHECK(stats.rejected == 2);
+    TEST_CHECK(stats.dropped == 0);
+
+    // An equal priority message drops the oldest
+    TEST_CHECK(InvokeValue(5, CB_PRIORITY_URGENT) == TRUE);
+    worker.GetQueueStats(&stats);
+    TEST_CHECK(stats.dropped == 1);
+
+    Drain(2);
+    TEST_CHECK(delivered.size() == 2 && delivered[0] == 2 && delivered[1] == 5);
+
+    // A higher priority message drops from the lowest lane first
+    delivered.clear();
+    valueCount = 0;
+    CloseGate(worker);
+    TEST_CHECK(InvokeValue(6, CB_PRIORITY_HIGH) == TRUE);
+    TEST_CHECK(InvokeValue(7, CB_PRIORITY_DEFAULT) == TRUE);
+    TEST_CHECK(InvokeValue(8, CB_PRIORITY_URGENT) == TRUE);
+    worker.GetQueueStats(&stats);
+    TEST_CHECK(stats.rejected == 2);
+    TEST_CHECK(stats.dropped == 2);
+
+    Drain(2);
+    TEST_CHECK(delivered.size() == 2 && delivered[0] == 8 && delivered[1] == 6);
+
+    CB_UnregisterTarget(ValueCb, ValueCallback, worker.GetDispatchTarget());
+    CB_Synchronize(ValueCb);
+}
+
+int main()
+{
+    ALLOC_Init();
+    CB_Init();
+
+    WorkerThread worker("Overflow");
+    worker.SetQueueCapacity(QUEUE_CAPACITY);
+    worker.SetOverflowPolicy(WorkerThread::OVERFLOW_DROP_OLDEST);
+    worker.CreateThread();
+
+    TestDropOldest(worker);
+
+    worker.ExitThread();
+
+    CB_Term();
+    ALLOC_Term();
+    return TEST_RESULT();
+}
@@ -0,0 +1,91 @@
+#ifndef _TEST_UTIL_H
+#define _TEST_UTIL_H
+
+#include "callback.h"
+#include "WorkerThreadStd.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// TestUtil.h
+// Minimal checks shared by the test executables. Each test file is one 
+// executable and returns TEST_RESULT() from main().
+
+static int testFailures = 0;
+
+// Report a failed condition and continue the test
+#define TEST_CHECK(condition) \
+    do { if (!(condition)) { std::cout << __FILE__ << "(" << __LINE__ << "): " \
+        << #condition << std::endl; testFailures++; } } while (0)
+
+// Exit code of the test executable
+#define TEST_RESULT()   (testFailures ? 1 : 0)
+
+// Poll a condition until it holds or the timeout expires
+// @return TRUE if the condition holds
+template <class Pred>
+static bool TestWaitFor(Pred pred, int timeoutMs = 2000)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (!pred())
+    {
+        if (std::chrono::steady_clock::now() > end)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Maximum allowed GateCb registrations
+#define GATE_REGISTER   2
+
+// Occupies a worker thread until released so tests can fill its queue
+CB_DECLARE(GateCb, const int*)
+CB_DEFINE(GateCb, const int*, sizeof(int), GATE_REGISTER)
+
+static std::atomic<bool> gateOpen(false);
+static std::atomic<int> gateEntered(0);
+static std::atomic<int> gateCount(0);
+
+static void GateCallback(const int* data, void* userData)
+{
+    gateEntered++;
+    while (!gateOpen.load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    gateCount++;
+}
+
+// Queue one GateCallback() message on a worker thread
+// @return TRUE if the worker queued the message
+static BOOL PostGate(WorkerThread& worker)
+{
+    int gate = 0;
+    BOOL success;
+    CB_RegisterTarget(GateCb, GateCallback, worker.GetDispatchTarget(), NULL);
+    success = CB_Invoke(GateCb, &gate);
+    CB_UnregisterTarget(GateCb, GateCallback, worker.GetDispatchTarget());
+    CB_Synchronize(GateCb);
+    return success;
+}
+
+// Block a worker thread within GateCallback() with its queue empty
+static void CloseGate(WorkerThread& worker)
+{
+    int entered = gateEntered;
+    gateOpen = false;
+    TEST_CHECK(PostGate(worker) == TRUE);
+    TEST_CHECK(TestWaitFor([&] { return gateEntered == entered + 1; }));
+}
+
+// Release the worker and wait for the gate and the queued gates behind it
+static void OpenGate(WorkerThread& worker, int queuedGates)
+{
+    int count = gateCount;
+    gateOpen = true;
+    while (!PostGate(worker))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    TEST_CHECK(TestWaitFor([&] { return gateCount == count + queuedGates + 2; }));
+}
+
+#endif
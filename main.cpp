@@ -56,6 +56,62 @@ void SysDataNoLockCallback(const SystemModeData* data, void* userData)
     cout << "SysDataNoLockCallback: " << data->CurrentSystemMode << endl;
 }
 
+// Invokes sent to each wait strategy comparison worker
+#define STRATEGY_INVOKES    200
+
+// Create a StrategyCb callback used to compare worker thread wait strategies
+CB_DECLARE(StrategyCb, int*)
+CB_DEFINE(StrategyCb, int*, sizeof(int), 3)
+
+void StrategyCallback(int* val, void* userData)
+{
+}
+
+//----------------------------------------------------------------------------
+// CompareWaitStrategies
+//----------------------------------------------------------------------------
+static void CompareWaitStrategies()
+{
+    static const char* names[] = { "WAIT_BLOCK", "WAIT_SPIN_THEN_PARK", "WAIT_BUSY_POLL" };
+    static const WorkerThread::WaitStrategy strategies[] = { WorkerThread::WAIT_BLOCK, 
+        WorkerThread::WAIT_SPIN_THEN_PARK, WorkerThread::WAIT_BUSY_POLL };
+    WorkerThread blockThread("BlockThread");
+    WorkerThread spinThread("SpinThread");
+    WorkerThread pollThread("PollThread");
+    WorkerThread* workers[] = { &blockThread, &spinThread, &pollThread };
+
+    // One worker per wait strategy, each subscribed to the same callback
+    for (int idx = 0; idx < 3; idx++)
+    {
+        workers[idx]->SetWaitStrategy(strategies[idx]);
+        workers[idx]->EnableLatencyStats(TRUE);
+        workers[idx]->CreateThread();
+        CB_RegisterTarget(StrategyCb, StrategyCallback, workers[idx]->GetDispatchTarget(), NULL);
+    }
+
+    // Pace the invokes so each worker returns to its idle wait between messages
+    for (int count = 0; count < STRATEGY_INVOKES; count++)
+    {
+        CB_Invoke(StrategyCb, &count);
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    for (int idx = 0; idx < 3; idx++)
+    {
+        WT_LatencyStats latency;
+        workers[idx]->GetLatencyStats(&latency);
+        cout << names[idx] << " dispatch latency avg/max ns: " << 
+            (latency.count ? latency.totalNs / latency.count : 0) << "/" << latency.maxNs << endl;
+        CB_UnregisterTarget(StrategyCb, StrategyCallback, workers[idx]->GetDispatchTarget());
+    }
+
+    // Wait for any invoke still using a worker before the workers exit
+    CB_Synchronize(StrategyCb);
+    for (int idx = 0; idx < 3; idx++)
+        workers[idx]->ExitThread();
+}
+
 int main()
 {
     BOOL success;
@@ -104,6 +160,9 @@ int main()
     // Give time for message processing on worker threads
     std::this_thread::sleep_for(std::chrono::seconds(1));
 
+    // Compare dispatch latency of each worker thread wait strategy
+    CompareWaitStrategies();
+
     // Unregister from all callbacks
     CB_Unregister(TestCb, TestCallback1, NULL);
     CB_Unregister(TestCb, TestCallback1, DispatchCallbackThread1);